@@ -25,17 +25,93 @@ static bool isNext( const SegmentPair& x, const SegmentPair& y ){
   return x.end1() == y.beg1() && x.end2() == y.beg2();
 }
 
-void Alignment::makeXdrop( Aligners &aligners, bool isGreedy, bool isFullScore,
+XdropKind::Enum cbrc::xdropKind(bool isGreedy, bool isBitVector,
+				int globality,
+				const ScoreMatrixRow *scoreMatrix,
+				int smMax, int smMin, int maxDrop,
+				const GapCosts &gap, const ScoreMatrixRow *pssm2,
+				const TwoQualityScoreMatrix &sm2qual,
+				const Alphabet &alph) {
+  if (isGreedy) return isBitVector ? XdropKind::bitVector : XdropKind::greedy;
+  if (sm2qual) return XdropKind::twoQual;
+  if (pssm2) return XdropKind::pssm;
+#if defined __SSE4_1__ || defined __ARM_NEON
+  bool isSimdMatrix = (alph.size == 4 && !globality && gap.isAffine &&
+		       smMin >= SCHAR_MIN &&
+		       maxDrop + smMax * 2 - smMin < UCHAR_MAX);
+  for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j)
+      if (scoreMatrix[i][j] != scoreMatrix[alph.numbersToLowercase[i]][j])
+	isSimdMatrix = false;
+  if (isSimdMatrix) return XdropKind::dna;
+#endif
+  return XdropKind::general;
+}
+
+// Restrict gapped extension from (start1, start2) to a band along
+// the anchors that lie ahead, in the extension direction
+static void setAnchorBand(GappedXdropAligner &aligner,
+			  const std::vector<SegmentPair> &anchors,
+			  size_t start1, size_t start2, bool isForward,
+			  int bandWidth) {
+  std::vector<size_t> points1, points2;
+  size_t n = anchors.size();
+  for (size_t k = 0; k < n; ++k) {
+    const SegmentPair &a = anchors[isForward ? k : n - 1 - k];
+    size_t b1, b2;  // coordinates of the anchor's nearest letters
+    if (isForward) {
+      if (a.beg1() < start1 || a.beg2() < start2) continue;
+      b1 = a.beg1() - start1;
+      b2 = a.beg2() - start2;
+    } else {
+      if (a.end1() > start1 || a.end2() > start2) continue;
+      b1 = start1 - a.end1();
+      b2 = start2 - a.end2();
+    }
+    if (!points1.empty() && (b1 <= points1.back() || b2 <= points2.back()))
+      continue;
+    points1.push_back(b1);
+    points2.push_back(b2);
+    points1.push_back(b1 + a.size - 1);
+    points2.push_back(b2 + a.size - 1);
+  }
+  aligner.setBand(points1, points2, bandWidth);
+}
+
+// Does the alignment come within 1 of the band's edge?  The chunks
+// are relative to the start of extension, farthest first.  This
+// checks every cell of each chunk, and both corners of each gap
+// between chunks (the path's offset from the band's diagonal changes
+// monotonically along each side of a gap).
+static bool isNearBandEdge(const GappedXdropAligner &aligner,
+			   const std::vector<SegmentPair> &chunks) {
+  size_t prevEnd1 = 0;
+  size_t prevEnd2 = 0;
+  for (size_t i = chunks.size(); i-- > 0;) {
+    const SegmentPair &c = chunks[i];
+    if (aligner.isNearBandEdge(c.beg1(), prevEnd2, 1) ||
+	aligner.isNearBandEdge(prevEnd1, c.beg2(), 1)) return true;
+    for (size_t k = 0; k < c.size; ++k)
+      if (aligner.isNearBandEdge(c.beg1() + k, c.beg2() + k, 1)) return true;
+    prevEnd1 = c.end1() - 1;
+    prevEnd2 = c.end2() - 1;
+  }
+  return false;
+}
+
+void Alignment::makeXdrop( Aligners &aligners, XdropKind::Enum kind,
+			   bool isFullScore,
 			   BigSeq seq1, const uchar *seq2, int globality,
-			   const ScoreMatrixRow* scoreMatrix,
-			   int smMax, int smMin,
+			   const ScoreMatrixRow* scoreMatrix, int smMax,
 			   const const_dbl_ptr* probMatrix, double scale,
 			   const GapCosts& gap, int maxDrop,
 			   size_t frameSize, const ScoreMatrixRow* pssm2,
                            const TwoQualityScoreMatrix& sm2qual,
                            const uchar* qual1, const uchar* qual2,
 			   const Alphabet& alph, AlignmentExtras& extras,
-			   double gamma, int outputType ){
+			   double gamma, int outputType,
+			   const std::vector<SegmentPair> *anchors,
+			   int bandWidth ){
   if (probMatrix) score = seed.score;  // else keep the old score
   if (outputType > 3 && !isFullScore) extras.fullScore = seed.score;
 
@@ -49,11 +125,11 @@ void Alignment::makeXdrop( Aligners &aligners, bool isGreedy, bool isFullScore,
   // extend a gapped alignment in the left/reverse direction from the seed:
   blocks.clear();
   std::vector<char>& columnAmbiguityCodes = extras.columnAmbiguityCodes;
-  extend( blocks, columnAmbiguityCodes, aligners, isGreedy, isFullScore,
+  extend( blocks, columnAmbiguityCodes, aligners, kind, isFullScore,
 	  seq1, seq2, seed.beg1(), seed.beg2(), false, globality,
-	  scoreMatrix, smMax, smMin, probMatrix, scale, maxDrop, gap,
+	  scoreMatrix, smMax, probMatrix, scale, maxDrop, gap,
 	  frameSize, pssm2, sm2qual, qual1, qual2, alph,
-	  extras, gamma, outputType );
+	  extras, gamma, outputType, anchors, bandWidth );
 
   if( score == -INF ) return;  // maybe unnecessary?
 
@@ -69,11 +145,11 @@ void Alignment::makeXdrop( Aligners &aligners, bool isGreedy, bool isFullScore,
   // extend a gapped alignment in the right/forward direction from the seed:
   std::vector<SegmentPair> forwardBlocks;
   std::vector<char> forwardAmbiguities;
-  extend( forwardBlocks, forwardAmbiguities, aligners, isGreedy, isFullScore,
+  extend( forwardBlocks, forwardAmbiguities, aligners, kind, isFullScore,
 	  seq1, seq2, seed.end1(), seed.end2(), true, globality,
-	  scoreMatrix, smMax, smMin, probMatrix, scale, maxDrop, gap,
+	  scoreMatrix, smMax, probMatrix, scale, maxDrop, gap,
 	  frameSize, pssm2, sm2qual, qual1, qual2, alph,
-	  extras, gamma, outputType );
+	  extras, gamma, outputType, anchors, bandWidth );
 
   if( score == -INF ) return;  // maybe unnecessary?
 
@@ -259,23 +335,27 @@ static void getColumnCodes(const FrameshiftXdropAligner &fxa,
 
 void Alignment::extend( std::vector< SegmentPair >& chunks,
 			std::vector< char >& columnCodes,
-			Aligners &aligners, bool isGreedy, bool isFullScore,
+			Aligners &aligners, XdropKind::Enum kind,
+			bool isFullScore,
 			BigSeq seq1, const uchar* seq2,
 			size_t start1, size_t start2,
 			bool isForward, int globality,
-			const ScoreMatrixRow* sm, int smMax, int smMin,
+			const ScoreMatrixRow* sm, int smMax,
 			const const_dbl_ptr* probMat, double scale,
 			int maxDrop, const GapCosts& gap, size_t frameSize,
 			const ScoreMatrixRow* pssm2,
 			const TwoQualityScoreMatrix& sm2qual,
                         const uchar* qual1, const uchar* qual2,
 			const Alphabet& alph, AlignmentExtras& extras,
-			double gamma, int outputType ){
+			double gamma, int outputType,
+			const std::vector<SegmentPair> *anchors,
+			int bandWidth ){
   const GapCosts::Piece &del = gap.delPieces[0];
   const GapCosts::Piece &ins = gap.insPieces[0];
   Centroid &centroid = aligners.centroid;
   GappedXdropAligner& aligner = centroid.aligner();
   GreedyXdropAligner &greedyAligner = aligners.greedyAligner;
+  BitVectorXdropAligner &bitVectorAligner = aligners.bitVectorAligner;
 
   double *subsCounts[scoreMatrixRowSize];
   double *tranCounts;
@@ -286,8 +366,27 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
     tranCounts = ec + scoreMatrixRowSize * scoreMatrixRowSize;
   }
 
+  if (anchors && !frameSize && outputType < 5 &&
+      (kind == XdropKind::pssm || kind == XdropKind::dna ||
+       kind == XdropKind::general)) {
+    double oldScore = score;
+    double oldFullScore = extras.fullScore;
+    setAnchorBand(aligner, *anchors, start1, start2, isForward, bandWidth);
+    extend(chunks, columnCodes, aligners, kind, isFullScore, seq1, seq2,
+	   start1, start2, isForward, globality, sm, smMax, probMat, scale,
+	   maxDrop, gap, frameSize, pssm2, sm2qual, qual1, qual2, alph,
+	   extras, gamma, outputType, 0, 0);
+    bool isOk = (score > -INF && !isNearBandEdge(aligner, chunks));
+    aligner.setBand(std::vector<size_t>(), std::vector<size_t>(), -1);
+    if (isOk) return;
+    score = oldScore;  // redo it without the band
+    extras.fullScore = oldFullScore;
+    chunks.clear();
+    columnCodes.clear();
+  }
+
   if( frameSize ){
-    assert( !isGreedy );
+    assert( kind != XdropKind::greedy && kind != XdropKind::bitVector );
     assert( !globality );
     assert( !pssm2 );
     assert( !sm2qual );
@@ -342,38 +441,41 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
   }
   const uchar *s2 = seq2 + start2;
 
-  bool isSimdMatrix = (alph.size == 4 && !globality && gap.isAffine &&
-		       smMin >= SCHAR_MIN &&
-		       maxDrop + smMax * 2 - smMin < UCHAR_MAX);
-  for (int i = 0; i < 4; ++i)
-    for (int j = 0; j < 4; ++j)
-      if (sm[i][j] != sm[alph.numbersToLowercase[i]][j])
-	isSimdMatrix = false;
+  int bitVectorScore = (kind == XdropKind::bitVector)
+    ? bitVectorAligner.align(seq1.beg + start1, s2,
+			     isForward, sm, maxDrop, alph.size) : 0;
+  if (bitVectorScore < 0) kind = XdropKind::greedy;  // it broke the X-drop
 
   int extensionScore =
-    isGreedy  ? greedyAligner.align(seq1.beg + start1, s2,
-				    isForward, sm, maxDrop, alph.size)
-    : sm2qual ? aligner.align2qual(seq1.beg + start1, qual1 + start1,
-				   s2, qual2 + start2,
-				   isForward, globality, sm2qual,
-				   del.openCost, del.growCost,
-				   ins.openCost, ins.growCost,
-				   gap.pairCost, gap.isAffine, maxDrop, smMax)
-    : pssm2   ? aligner.alignPssm(seq1 + start1, pssm2 + start2,
-				  isForward, globality,
-				  del.openCost, del.growCost,
-				  ins.openCost, ins.growCost,
-				  gap.pairCost, gap.isAffine, maxDrop, smMax)
+    (kind == XdropKind::greedy)
+    ? greedyAligner.align(seq1.beg + start1, s2,
+			  isForward, sm, maxDrop, alph.size)
+    : (kind == XdropKind::bitVector)
+    ? bitVectorScore
+    : (kind == XdropKind::twoQual)
+    ? aligner.align2qual(seq1.beg + start1, qual1 + start1,
+			 s2, qual2 + start2,
+			 isForward, globality, sm2qual,
+			 del.openCost, del.growCost,
+			 ins.openCost, ins.growCost,
+			 gap.pairCost, gap.isAffine, maxDrop, smMax)
+    : (kind == XdropKind::pssm)
+    ? aligner.alignPssm(seq1 + start1, pssm2 + start2,
+			isForward, globality,
+			del.openCost, del.growCost,
+			ins.openCost, ins.growCost,
+			gap.pairCost, gap.isAffine, maxDrop, smMax)
 #if defined __SSE4_1__ || defined __ARM_NEON
-    : isSimdMatrix ? aligner.alignDna(seq1 + start1, s2, isForward, sm,
-				      del.openCost, del.growCost,
-				      ins.openCost, ins.growCost,
-				      maxDrop, smMax, alph.numbersToUppercase)
+    : (kind == XdropKind::dna)
+    ? aligner.alignDna(seq1 + start1, s2, isForward, sm,
+		       del.openCost, del.growCost,
+		       ins.openCost, ins.growCost,
+		       maxDrop, smMax, alph.numbersToUppercase)
 #endif
-    :           aligner.align(seq1 + start1, s2, isForward, globality, sm,
-			      del.openCost, del.growCost,
-			      ins.openCost, ins.growCost,
-			      gap.pairCost, gap.isAffine, maxDrop, smMax);
+    : aligner.align(seq1 + start1, s2, isForward, globality, sm,
+		    del.openCost, del.growCost,
+		    ins.openCost, ins.growCost,
+		    gap.pairCost, gap.isAffine, maxDrop, smMax);
 
   if( extensionScore == -INF ){
     score = -INF;  // avoid score overflow
@@ -382,12 +484,16 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
 
   if( outputType < 5 || outputType > 6 ){  // ordinary max-score alignment
     size_t end1, end2, size;
-    if( isGreedy ){
+    if (kind == XdropKind::greedy) {
       while( greedyAligner.getNextChunk( end1, end2, size ) )
 	chunks.push_back( SegmentPair( end1 - size, end2 - size, size ) );
     }
+    else if (kind == XdropKind::bitVector) {
+      while (bitVectorAligner.getNextChunk(end1, end2, size))
+	chunks.push_back(SegmentPair(end1 - size, end2 - size, size));
+    }
 #if defined __SSE4_1__ || defined __ARM_NEON
-    else if (isSimdMatrix && !pssm2 && !sm2qual) {
+    else if (kind == XdropKind::dna) {
       while (aligner.getNextChunkDna(end1, end2, size,
 				     del.openCost, del.growCost,
 				     ins.openCost, ins.growCost))
@@ -406,7 +512,7 @@ void Alignment::extend( std::vector< SegmentPair >& chunks,
   if (!isFullScore) score += extensionScore;
 
   if (outputType > 3 || isFullScore) {
-    assert( !isGreedy );
+    assert( kind != XdropKind::greedy && kind != XdropKind::bitVector );
     assert( !sm2qual );
     double s = centroid.forward(seq1 + start1, s2, start2, isForward,
 				probMat, gap, globality);
@@ -5,6 +5,7 @@
 #ifndef ALIGNMENT_HH
 #define ALIGNMENT_HH
 
+#include "BitVectorXdropAligner.hh"
 #include "Centroid.hh"
 #include "GreedyXdropAligner.hh"
 #include "SegmentPair.hh"
@@ -24,6 +25,7 @@ struct Aligners {
   Centroid centroid;
   FrameshiftXdropAligner frameshiftAligner;
   GreedyXdropAligner greedyAligner;
+  BitVectorXdropAligner bitVectorAligner;
 };
 
 struct AlignmentText {
@@ -62,6 +64,20 @@ struct AlignmentText {
   }
 };
 
+// The kind of gapped X-drop extension.  It depends only on settings
+// that are fixed for each query, so it is found once (by xdropKind),
+// rather than for each extension.
+namespace XdropKind {
+  enum Enum { greedy, bitVector, twoQual, pssm, dna, general };
+}
+
+XdropKind::Enum xdropKind(bool isGreedy, bool isBitVector, int globality,
+			  const ScoreMatrixRow *scoreMatrix,
+			  int smMax, int smMin, int maxDrop,
+			  const GapCosts &gap, const ScoreMatrixRow *pssm2,
+			  const TwoQualityScoreMatrix &sm2qual,
+			  const Alphabet &alph);
+
 struct AlignmentExtras {
   // Optional (probabilistic) attributes of an alignment.
   // To save memory, these are outside the main Alignment struct.
@@ -83,16 +99,24 @@ struct Alignment{
   // Alignment might not be "optimal" (see below).
   // If outputType > 3: calculates match probabilities.
   // If outputType > 4: does gamma-centroid alignment.
-  void makeXdrop( Aligners &aligners, bool isGreedy, bool isFullScore,
+  // If anchors are given (colinear SegmentPairs, sorted by position),
+  // it first tries extending within bandWidth diagonals of a path
+  // through them, and redoes an extension without the band if its
+  // alignment comes near the band's edge.  So the result may differ
+  // from unbanded extension, if a better alignment lies outside the
+  // band.
+  void makeXdrop( Aligners &aligners, XdropKind::Enum kind, bool isFullScore,
 		  BigSeq seq1, const uchar* seq2, int globality,
-		  const ScoreMatrixRow* scoreMatrix, int smMax, int smMin,
+		  const ScoreMatrixRow* scoreMatrix, int smMax,
 		  const const_dbl_ptr* probMatrix, double scale,
 		  const GapCosts& gap, int maxDrop, size_t frameSize,
 		  const ScoreMatrixRow* pssm2,
                   const TwoQualityScoreMatrix& sm2qual,
                   const uchar* qual1, const uchar* qual2,
 		  const Alphabet& alph, AlignmentExtras& extras,
-		  double gamma = 0, int outputType = 0 );
+		  double gamma = 0, int outputType = 0,
+		  const std::vector<SegmentPair> *anchors = 0,
+		  int bandWidth = 0 );
 
   // Check that the Alignment has no prefix with score <= 0, no suffix
   // with score <= 0, and no sub-segment with score < -maxDrop.
@@ -136,17 +160,18 @@ struct Alignment{
 
   void extend( std::vector< SegmentPair >& chunks,
 	       std::vector< char >& columnCodes,
-	       Aligners &aligners, bool isGreedy, bool isFullScore,
+	       Aligners &aligners, XdropKind::Enum kind, bool isFullScore,
 	       BigSeq seq1, const uchar* seq2, size_t start1, size_t start2,
 	       bool isForward, int globality,
-	       const ScoreMatrixRow* sm, int smMax, int smMin,
+	       const ScoreMatrixRow* sm, int smMax,
 	       const const_dbl_ptr* probMat, double scale,
 	       int maxDrop, const GapCosts& gap, size_t frameSize,
 	       const ScoreMatrixRow* pssm2,
                const TwoQualityScoreMatrix& sm2qual,
                const uchar* qual1, const uchar* qual2,
 	       const Alphabet& alph, AlignmentExtras& extras,
-	       double gamma, int outputType );
+	       double gamma, int outputType,
+	       const std::vector<SegmentPair> *anchors, int bandWidth );
 
   AlignmentText writeTab(const MultiSequence& seq1, const MultiSequence& seq2,
 			 size_t seqNum2, bool isTranslated,
@@ -159,6 +184,18 @@ struct Alignment{
 			 int translationType, const LastEvaluer& evaluer,
 			 const AlignmentExtras& extras) const;
 
+  // SAM format, with no header, and no reverse-strand seq1
+  AlignmentText writeSam(const MultiSequence& seq1, const MultiSequence& seq2,
+			 size_t seqNum2, const uchar* seqData2,
+			 const Alphabet& alph, const LastEvaluer& evaluer,
+			 const AlignmentExtras& extras) const;
+
+  // PAF format, with a cg:Z CIGAR tag, for non-translated alignments
+  AlignmentText writePaf(const MultiSequence& seq1, const MultiSequence& seq2,
+			 size_t seqNum2, const uchar* seqData2,
+			 const Alphabet& alph, const LastEvaluer& evaluer,
+			 const AlignmentExtras& extras) const;
+
   AlignmentText writeBlastTab(const MultiSequence& seq1,
 			      const MultiSequence& seq2,
 			      size_t seqNum2, const uchar* seqData2,
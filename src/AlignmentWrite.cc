@@ -5,11 +5,11 @@
 #include "LastEvaluer.hh"
 #include "MultiSequence.hh"
 #include "Alphabet.hh"
+#include "mcf_number_text.hh"
 
 #include <assert.h>
 
 #include <algorithm>
-#include <cstdio>  // sprintf
 
 using namespace cbrc;
 
@@ -40,12 +40,7 @@ const char aminoTriplets[] =
 // This writes a "size_t" integer into a char buffer ending at "end".
 // It writes backwards from the end, because that's easier & faster.
 static char *writeSize(char *end, size_t x) {
-  do {
-    --end;
-    *end = '0' + x % 10;
-    x /= 10;
-  } while (x);
-  return end;
+  return mcf::writeDigitsBackwards(end, x);
 }
 
 // write x - y as a signed integer
@@ -74,8 +69,9 @@ private:
 class FloatText {  // a text representation of a floating-point number
 public:
   FloatText() {}
-  FloatText(const char *format, double x) { set(format, x); }
-  void set(const char *format, double x) { s = std::sprintf(b, format, x); }
+  // like sprintf "%.*f" and "%.*g", but faster
+  void setFixed(double x, int places) { s = mcf::sprintFixed(b, x, places); }
+  void setGeneral(double x, int prec) { s = mcf::sprintGeneral(b, x, prec); }
   const char *begin() const { return b; }
   size_t size() const { return s; }
 private:
@@ -129,6 +125,10 @@ AlignmentText Alignment::write(const MultiSequence& seq1,
 		    alph, dnaAlph, translationType, evaluer, extras);
   if (format == 't')
     return writeTab(seq1, seq2, seqNum2, translationType, evaluer, extras);
+  if (format == 's' || format == 'S')
+    return writeSam(seq1, seq2, seqNum2, seqData2, alph, evaluer, extras);
+  if (format == 'p')
+    return writePaf(seq1, seq2, seqNum2, seqData2, alph, evaluer, extras);
   else
     return writeBlastTab(seq1, seq2, seqNum2, seqData2, alph, translationType,
 			 codonToAmino, evaluer, extras, format == 'B');
@@ -183,8 +183,14 @@ static size_t writeBlocks(std::vector<char> &text,
   return end - e;
 }
 
-static const char *scoreFormat(bool isIntegerScores) {
-  return isIntegerScores ? "%.0f" : "%.1f";
+static int scoreDecimals(bool isIntegerScores) {
+  return isIntegerScores ? 0 : 1;
+}
+
+static char *copyText(char *out, const char *s) {
+  size_t n = std::strlen(s);
+  std::memcpy(out, s, n);
+  return out + n;
 }
 
 static char* writeTags( const LastEvaluer& evaluer, double queryLength,
@@ -194,13 +200,16 @@ static char* writeTags( const LastEvaluer& evaluer, double queryLength,
     double epa = evaluer.evaluePerArea( score );
     double area = evaluer.area( score, queryLength );
     *out++ = separator;
-    out += std::sprintf( out, "EG2=%.2g", 1e18 * epa );
+    out = copyText( out, "EG2=" );
+    out += mcf::sprintGeneral( out, 1e18 * epa, 2 );
     *out++ = separator;
-    out += std::sprintf( out, "E=%.2g", area * epa );
+    out = copyText( out, "E=" );
+    out += mcf::sprintGeneral( out, area * epa, 2 );
   }
   if( fullScore > 0 ){
     *out++ = separator;
-    out += std::sprintf( out, "fullScore=%.3g", fullScore );
+    out = copyText( out, "fullScore=" );
+    out += mcf::sprintGeneral( out, fullScore, 3 );
   }
   *out++ = '\n';
   return out;
@@ -224,7 +233,8 @@ AlignmentText Alignment::writeTab(const MultiSequence& seq1,
   size_t seqStart2 = seq2.seqBeg(seqNum2) - seq2.padBeg(seqNum2);
   size_t seqLen2 = seq2.seqLen(seqNum2);
 
-  FloatText sc(scoreFormat(extras.fullScore >= 0), score);
+  FloatText sc;
+  sc.setFixed(score, scoreDecimals(extras.fullScore >= 0));
   std::string n1 = seq1.seqName(seqNum1);
   char strand1 = seq1.strand(seqNum1);
   std::string n2 = seq2.seqName(seqNum2);
@@ -275,8 +285,8 @@ static void putRight(Writer &w, const IntText &t, size_t width) {
 // Write an "a" line
 static char *writeMafLineA(char *out, double score, const LastEvaluer& evaluer,
 			   double queryLength, double fullScore) {
-  out += std::sprintf(out, "a score=");
-  out += std::sprintf(out, scoreFormat(fullScore >= 0), score);
+  out = copyText(out, "a score=");
+  out += mcf::sprintFixed(out, score, scoreDecimals(fullScore >= 0));
   return writeTags(evaluer, queryLength, score, fullScore, ' ', out);
 }
 
@@ -329,12 +339,14 @@ static void writeMafLineC(std::vector<char> &cLine,
       if (x != i) c += counts[x * scoreMatrixRowSize + j];
       if (y != j) c += counts[i * scoreMatrixRowSize + y];
       if (x != i && y != j) c += counts[x * scoreMatrixRowSize + y];
-      e += std::sprintf(e, " %.3g", c);
+      *e++ = ' ';
+      e += mcf::sprintGeneral(e, c, 3);
     }
   }
 
   for (size_t i = 0; i < numOfTransitions; ++i) {
-    e += std::sprintf(e, " %.3g", counts[numOfSubstitutions + i]);
+    *e++ = ' ';
+    e += mcf::sprintGeneral(e, counts[numOfSubstitutions + i], 3);
   }
 
   *e++ = '\n';
@@ -500,7 +512,8 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
 
   std::string n1 = seq1.seqName(seqNum1);
   std::string n2 = seq2.seqName(seqNum2);
-  FloatText mp("%.2f", matchPercent);
+  FloatText mp;
+  mp.setFixed(matchPercent, 2);
   IntText as(alnSize);
   IntText mm(mismatches);
   IntText go(gapOpens);
@@ -514,8 +527,8 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
     double area = evaluer.area( score, seqLen2 );
     double epa = evaluer.evaluePerArea( score );
     double bitScore = evaluer.bitScore( score );
-    ev.set("%.2g", area * epa);
-    bs.set("%.3g", bitScore);
+    ev.setGeneral(area * epa, 2);
+    bs.setGeneral(bitScore, 3);
   }
   IntText s1(seqLen1);
   IntText s2(seqLen2);
@@ -526,7 +539,7 @@ AlignmentText Alignment::writeBlastTab(const MultiSequence& seq1,
     b2.size() + e2.size() + b1.size() + e1.size() + 10;
   if (evaluer.isGood()) s += ev.size() + bs.size() + 2;
   if (isExtraColumns) {
-    sc.set(scoreFormat(extras.fullScore >= 0), score);
+    sc.setFixed(score, scoreDecimals(extras.fullScore >= 0));
     s += s1.size() + s2.size() + sc.size() + 3;
   }
 
@@ -721,3 +734,221 @@ char *Alignment::writeColumnProbs(char *dest, const char *probSymbols,
 
   return dest;
 }
+
+// Append one CIGAR operation, merging it with the previous one if
+// they are the same
+static void addCigarOp(std::string &cigar, char &oldOp, size_t &oldLen,
+		       char op, size_t len) {
+  if (op != oldOp) {
+    if (oldLen) {
+      IntText t(oldLen);
+      cigar.append(t.begin(), t.size());
+      cigar += oldOp;
+    }
+    oldOp = op;
+    oldLen = 0;
+  }
+  oldLen += len;
+}
+
+// The SAM flag for a query.  Like maf-convert, treat names ending in
+// /1 or /2 as paired reads, and strip that suffix from the name.
+static int samFlag(std::string &name, char strand) {
+  size_t s = name.size();
+  if (s > 1 && name[s - 2] == '/' && (name[s - 1] == '1' ||
+				      name[s - 1] == '2')) {
+    bool isSecond = (name[s - 1] == '2');
+    name.resize(s - 2);
+    return (strand == '-') ? 83 + isSecond * 64 : 99 + isSecond * 64;
+  }
+  return (strand == '-') ? 16 : 0;
+}
+
+AlignmentText Alignment::writeSam(const MultiSequence& seq1,
+				  const MultiSequence& seq2,
+				  size_t seqNum2, const uchar* seqData2,
+				  const Alphabet& alph,
+				  const LastEvaluer& evaluer,
+				  const AlignmentExtras& extras) const {
+  size_t alnBeg1 = beg1();
+  size_t seqNum1 = seq1.whichSequence(alnBeg1);
+  size_t seqStart1 = seq1.seqBeg(seqNum1);
+
+  size_t alnBeg2 = beg2();
+  size_t alnEnd2 = end2();
+  size_t seqOrigin2 = seq2.padBeg(seqNum2);
+  size_t seqStart2 = seq2.seqBeg(seqNum2) - seqOrigin2;
+  size_t seqLen2 = seq2.seqLen(seqNum2);
+  char strand2 = seq2.strand(seqNum2);
+
+  BigSeq s1 = seq1.seqPtr();
+  const uchar *toUpper = alph.numbersToUppercase;
+  std::string cigar;
+  char op = 0;
+  size_t len = 0;
+  size_t editDistance = 0;
+  addCigarOp(cigar, op, len, 'H', alnBeg2 - seqStart2);
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    const SegmentPair &y = blocks[i];
+    if (i > 0) {  // between each pair of aligned blocks:
+      const SegmentPair &x = blocks[i - 1];
+      addCigarOp(cigar, op, len, 'D', y.beg1() - x.end1());
+      addCigarOp(cigar, op, len, 'I', y.beg2() - x.end2());
+      editDistance += (y.beg1() - x.end1()) + (y.beg2() - x.end2());
+    }
+    for (size_t j = 0; j < y.size; ++j) {
+      uchar x1 = toUpper[s1[y.beg1() + j]];
+      uchar x2 = toUpper[seqData2[y.beg2() + j]];
+      bool isSame = (x1 == x2);
+      addCigarOp(cigar, op, len, isSame ? '=' : 'X', 1);
+      editDistance += !isSame;
+    }
+  }
+  addCigarOp(cigar, op, len, 'H', seqStart2 + seqLen2 - alnEnd2);
+  addCigarOp(cigar, op, len, 0, 0);
+
+  std::string n1 = seq1.seqName(seqNum1);
+  std::string n2 = seq2.seqName(seqNum2);
+  IntText flag(samFlag(n2, strand2));
+  IntText pos(alnBeg1 - seqStart1 + 1);  // 1-based coordinate
+  IntText nm(editDistance);
+  FloatText as;
+  FloatText ev;
+  if (extras.fullScore >= 0) as.setFixed(score, 0);
+  if (evaluer.isGood()) {
+    double area = evaluer.area(score, seqLen2);
+    double epa = evaluer.evaluePerArea(score);
+    ev.setGeneral(area * epa, 2);
+  }
+  size_t qualsPerBase2 = seq2.qualsPerLetter();
+  size_t seqSize = alnEnd2 - alnBeg2;
+
+  size_t s = n2.size() + flag.size() + n1.size() + pos.size() + cigar.size() +
+    seqSize * 2 + nm.size() + 32;
+  if (extras.fullScore >= 0) s += as.size() + 6;
+  if (evaluer.isGood()) s += ev.size() + 6;
+
+  char *text = new char[s + 1];
+  Writer w(text);
+  const char t = '\t';
+  w << n2 << t << flag << t << n1 << t << pos;
+  w.copy("\t255\t", 5);  // mapping quality unavailable
+  w << cigar;
+  w.copy("\t*\t0\t0\t", 7);
+  BigSeq bigSeq2 = {seqData2, false};
+  char *dest = alph.rtCopy(w.pointer(), bigSeq2, alnBeg2, alnEnd2);
+  *dest++ = t;
+  if (qualsPerBase2) {
+    const uchar *q = seq2.qualityReader() + seqOrigin2 * qualsPerBase2;
+    dest = writeQuals(dest, q, alnBeg2, alnEnd2, qualsPerBase2);
+  } else {
+    *dest++ = '*';
+  }
+  Writer v(dest);
+  v.copy("\tNM:i:", 6);
+  v << nm;
+  if (extras.fullScore >= 0) { v.copy("\tAS:i:", 6); v << as; }
+  if (evaluer.isGood()) { v.copy("\tEV:Z:", 6); v << ev; }
+  v << '\n' << '\0';
+
+  return AlignmentText(seqNum2, alnBeg2, alnEnd2, strand2, score, 0, 0, text);
+}
+
+AlignmentText Alignment::writePaf(const MultiSequence& seq1,
+				  const MultiSequence& seq2,
+				  size_t seqNum2, const uchar* seqData2,
+				  const Alphabet& alph,
+				  const LastEvaluer& evaluer,
+				  const AlignmentExtras& extras) const {
+  size_t alnBeg1 = beg1();
+  size_t alnEnd1 = end1();
+  size_t seqNum1 = seq1.whichSequence(alnBeg1);
+  size_t seqStart1 = seq1.seqBeg(seqNum1);
+  size_t seqLen1 = seq1.seqLen(seqNum1);
+  char strand1 = seq1.strand(seqNum1);
+
+  size_t alnBeg2 = beg2();
+  size_t alnEnd2 = end2();
+  size_t seqStart2 = seq2.seqBeg(seqNum2) - seq2.padBeg(seqNum2);
+  size_t seqLen2 = seq2.seqLen(seqNum2);
+  char strand2 = seq2.strand(seqNum2);
+
+  // PAF uses forward-strand coordinates, and a CIGAR string along the
+  // forward strand of seq1
+  size_t pafBeg1 = alnBeg1 - seqStart1;
+  size_t pafEnd1 = alnEnd1 - seqStart1;
+  if (strand1 == '-') {
+    pafBeg1 = seqStart1 + seqLen1 - alnEnd1;
+    pafEnd1 = seqStart1 + seqLen1 - alnBeg1;
+  }
+  size_t pafBeg2 = alnBeg2 - seqStart2;
+  size_t pafEnd2 = alnEnd2 - seqStart2;
+  if (strand2 == '-') {
+    pafBeg2 = seqStart2 + seqLen2 - alnEnd2;
+    pafEnd2 = seqStart2 + seqLen2 - alnBeg2;
+  }
+
+  const uchar *map = alph.numbersToUppercase;
+  size_t matches = matchCount(blocks, seq1.seqPtr(), seqData2, map, map);
+  size_t alnSize = numColumns(0, false);
+
+  std::string cigar;
+  char op = 0;
+  size_t len = 0;
+  size_t n = blocks.size();
+  for (size_t i = 0; i < n; ++i) {
+    size_t k = (strand1 == '-') ? n - 1 - i : i;
+    const SegmentPair &y = blocks[k];
+    if (i > 0) {  // between each pair of aligned blocks:
+      const SegmentPair &x = blocks[(strand1 == '-') ? k : k - 1];
+      const SegmentPair &z = blocks[(strand1 == '-') ? k + 1 : k];
+      addCigarOp(cigar, op, len, 'D', z.beg1() - x.end1());
+      addCigarOp(cigar, op, len, 'I', z.beg2() - x.end2());
+    }
+    addCigarOp(cigar, op, len, 'M', y.size);
+  }
+  addCigarOp(cigar, op, len, 0, 0);
+
+  std::string n1 = seq1.seqName(seqNum1);
+  std::string n2 = seq2.seqName(seqNum2);
+  IntText s2(seqLen2);
+  IntText b2(pafBeg2);
+  IntText e2(pafEnd2);
+  IntText s1(seqLen1);
+  IntText b1(pafBeg1);
+  IntText e1(pafEnd1);
+  IntText mc(matches);
+  IntText sz(alnSize);
+  IntText nm(alnSize - matches);
+  FloatText as;
+  FloatText ev;
+  if (extras.fullScore >= 0) as.setFixed(score, 0);
+  if (evaluer.isGood()) {
+    double area = evaluer.area(score, seqLen2);
+    double epa = evaluer.evaluePerArea(score);
+    ev.setGeneral(area * epa, 2);
+  }
+
+  size_t s = n2.size() + s2.size() + b2.size() + e2.size() +
+    n1.size() + s1.size() + b1.size() + e1.size() +
+    mc.size() + sz.size() + nm.size() + cigar.size() + 32;
+  if (extras.fullScore >= 0) s += as.size() + 6;
+  if (evaluer.isGood()) s += ev.size() + 6;
+
+  char *text = new char[s + 1];
+  Writer w(text);
+  const char t = '\t';
+  w << n2 << t << s2 << t << b2 << t << e2 << t;
+  w << (strand1 == strand2 ? '+' : '-') << t;
+  w << n1 << t << s1 << t << b1 << t << e1 << t;
+  w << mc << t << sz;
+  w.copy("\t255\tNM:i:", 10);  // mapping quality unavailable
+  w << nm;
+  if (extras.fullScore >= 0) { w.copy("\tAS:i:", 6); w << as; }
+  if (evaluer.isGood()) { w.copy("\tEV:Z:", 6); w << ev; }
+  w.copy("\tcg:Z:", 6);
+  w << cigar << '\n' << '\0';
+
+  return AlignmentText(seqNum2, alnBeg2, alnEnd2, strand2, score,
+		       alnSize, matches, text);
+}
@@ -0,0 +1,301 @@
+// Copyright 2026 Martin C. Frith
+
+#include "BitVectorXdropAligner.hh"
+#include <algorithm>
+#include <cassert>
+#include <climits>
+
+namespace cbrc {
+
+// i:         number of seq1 letters aligned so far (the row)
+// j:         number of seq2 letters aligned so far (the column)
+// distance:  edit distance between the first i and j letters
+
+// Row i > 0 is bit (i-1) % 64 of block (i-1) / 64.  A block's
+// distances in a column are stored as its bottom row's distance, and
+// the difference between each row and the one above it.
+
+// Cells above a column's first block, or in a block that was just
+// added, get distances from a horizontal or vertical path through
+// stored cells.  These are upper bounds, so we never underestimate
+// a distance, and the trace-back can always follow them.
+
+const int blockRows = 64;
+
+static int popCount(uint64_t x) { return __builtin_popcountll(x); }
+
+static int lowestBit(uint64_t x) { return __builtin_ctzll(x); }
+
+// The sum of differences below row r of a block
+static int diffsBelow(uint64_t plusVec, uint64_t minusVec, int r) {
+  if (r + 1 == blockRows) return 0;
+  uint64_t below = ~uint64_t(0) << (r + 1);
+  return popCount(plusVec & below) - popCount(minusVec & below);
+}
+
+// Move a block's vertical differences from one column to the next,
+// given its matches with the next column's letter, and the horizontal
+// difference (-1, 0, or 1) at the row above it.  Return the
+// horizontal difference at its bottom row.
+static int advanceBlock(uint64_t &plusVec, uint64_t &minusVec,
+			uint64_t matches, int hIn) {
+  uint64_t pv = plusVec;
+  uint64_t mv = minusVec;
+  uint64_t xv = matches | mv;
+  if (hIn < 0) matches |= 1;
+  uint64_t xh = (((matches & pv) + pv) ^ pv) | matches;
+  uint64_t ph = mv | ~(xh | pv);
+  uint64_t mh = pv & xh;
+  int hOut = int(ph >> (blockRows - 1)) - int(mh >> (blockRows - 1));
+  ph <<= 1;
+  mh <<= 1;
+  if (hIn < 0) mh |= 1;
+  if (hIn > 0) ph |= 1;
+  plusVec = mh | ~(xv | ph);
+  minusVec = ph & xv;
+  return hOut;
+}
+
+void BitVectorXdropAligner::addBlockLetters(size_t block) {
+  matchVecs.resize(matchVecs.size() + scoreMatrixRowSize);
+  isMatchVecDone.resize(isMatchVecDone.size() + scoreMatrixRowSize);
+  size_t beg = block * blockRows;
+  for (int r = 0; r < blockRows; ++r) {
+    if (letter1(beg + r) == delimiterLetter) {
+      seq1length = beg + r;
+      break;
+    }
+  }
+}
+
+BitVectorXdropAligner::Word BitVectorXdropAligner::matchVec(size_t block,
+							     uchar letter2) {
+  size_t k = block * scoreMatrixRowSize + letter2;
+  if (!isMatchVecDone[k]) {
+    size_t beg = block * blockRows;
+    size_t end = std::min(beg + blockRows, seq1length);
+    Word m = 0;
+    for (size_t i = beg; i < end; ++i) {
+      if (scoreMatrix[letter1(i)][letter2] > 0) m |= Word(1) << (i - beg);
+    }
+    matchVecs[k] = m;
+    isMatchVecDone[k] = 1;
+  }
+  return matchVecs[k];
+}
+
+bool BitVectorXdropAligner::isKnown(size_t i, size_t j) const {
+  if (i == 0) return true;
+  size_t b = (i - 1) / blockRows;
+  size_t f = columnBlockBegs[j];
+  if (b < f) return i == f * blockRows;
+  return b < f + (columnOrigins[j + 1] - columnOrigins[j]);
+}
+
+int BitVectorXdropAligner::distance(size_t i, size_t j) const {
+  if (i == 0) return j;
+  size_t b = (i - 1) / blockRows;
+  int r = (i - 1) % blockRows;
+  int horizontalSteps = 0;
+  while (b < columnBlockBegs[j]) {
+    --j;
+    ++horizontalSteps;
+  }
+  size_t k = columnOrigins[j] + (b - columnBlockBegs[j]);
+  return bottomDists[k] - diffsBelow(plusVecs[k], minusVecs[k], r) +
+    horizontalSteps;
+}
+
+int BitVectorXdropAligner::step(size_t i, size_t j) const {
+  if ((i - 1) / blockRows < columnBlockBegs[j]) return 2;
+  int d = distance(i, j);
+  if (isKnown(i - 1, j - 1) &&
+      distance(i - 1, j - 1) + !isMatch(i, j) == d) return 0;
+  if (distance(i - 1, j) + 1 == d) return 1;
+  return 2;
+}
+
+int BitVectorXdropAligner::align(const uchar *seq1,
+				 const uchar *seq2,
+				 bool isForward,
+				 const ScoreMatrixRow *scorer,
+				 int maxScoreDrop,
+				 uchar delimiter) {
+  const int matchScore = scorer[0][0];
+  const int mismatchScore = scorer[0][1];
+  assert(matchScore % 2 == 0);
+  const int halfMatchScore = matchScore / 2;
+  const int differenceCost = matchScore - mismatchScore;
+
+  seq1beg = seq1;
+  seq2beg = seq2;
+  isForwardExtension = isForward;
+  scoreMatrix = scorer;
+  delimiterLetter = delimiter;
+  seq1length = -1;
+
+  // column 0: distance = i
+  plusVecs.assign(1, ~Word(0));
+  minusVecs.assign(1, 0);
+  bottomDists.assign(1, blockRows);
+  columnOrigins.assign(1, 0);
+  columnOrigins.push_back(1);
+  columnBlockBegs.assign(1, 0);
+  matchVecs.clear();
+  isMatchVecDone.clear();
+  addBlockLetters(0);
+
+  size_t blockBeg = 0;
+  size_t blockEnd = 1;
+  int bestScore = 0;
+  bestPos1 = 0;
+  bestPos2 = 0;
+
+  for (size_t j = 1; ; ++j) {
+    uchar y = letter2(j - 1);
+    if (y == delimiter) break;
+
+    size_t oldOrigin =
+      columnOrigins[j - 1] + (blockBeg - columnBlockBegs[j - 1]);
+    int h = 1;  // the distance grows by 1 along the row above blockBeg
+    for (size_t b = blockBeg; b < blockEnd; ++b) {
+      size_t k = oldOrigin + (b - blockBeg);
+      Word pv = plusVecs[k];
+      Word mv = minusVecs[k];
+      h = advanceBlock(pv, mv, matchVec(b, y), h);
+      plusVecs.push_back(pv);
+      minusVecs.push_back(mv);
+      bottomDists.push_back(bottomDists[k] + h);
+    }
+    size_t origin = columnOrigins.back();
+    columnOrigins.push_back(plusVecs.size());
+    columnBlockBegs.push_back(blockBeg);
+
+    // Check each block's rows where the score stops rising (and
+    // starts falling) downwards, and the first and last rows
+    blockMaxScores.clear();
+    for (size_t b = blockBeg; b < blockEnd; ++b) {
+      size_t k = origin + (b - blockBeg);
+      Word pv = plusVecs[k];
+      Word mv = minusVecs[k];
+      size_t rowBeg = b * blockRows;
+      Word lastRow = Word(1) << (blockRows - 1);
+      Word rows = ~Word(0);
+      if (seq1length < rowBeg + blockRows) {
+	size_t n = seq1length - rowBeg;
+	lastRow = n ? Word(1) << (n - 1) : 0;
+	rows = (Word(1) << n) - 1;
+      }
+      Word peaks = ((~pv & ((pv >> 1) | lastRow)) | 1) & rows;
+      int blockMaxScore = INT_MIN;
+      while (peaks) {
+	int r = lowestBit(peaks);
+	peaks &= peaks - 1;
+	int d = bottomDists[k] - diffsBelow(pv, mv, r);
+	size_t i = rowBeg + r + 1;
+	int score = halfMatchScore * int(i + j) - differenceCost * d;
+	if (score > blockMaxScore) blockMaxScore = score;
+	if (score > bestScore) {
+	  bestScore = score;
+	  bestPos1 = i;
+	  bestPos2 = j;
+	}
+      }
+      blockMaxScores.push_back(blockMaxScore);
+    }
+
+    int minScore = bestScore - maxScoreDrop;
+    size_t oldBlockBeg = blockBeg;
+    size_t oldBlockEnd = blockEnd;
+    while (blockBeg < blockEnd &&
+	   blockMaxScores[blockBeg - oldBlockBeg] < minScore) ++blockBeg;
+    while (blockEnd > blockBeg &&
+	   blockMaxScores[blockEnd - 1 - oldBlockBeg] < minScore) --blockEnd;
+    if (blockBeg == blockEnd) break;
+
+    if (blockEnd == oldBlockEnd) {
+      size_t k = origin + (blockEnd - 1 - oldBlockBeg);
+      size_t i = blockEnd * blockRows;
+      int score = halfMatchScore * int(i + j) -
+	differenceCost * bottomDists[k];
+      if (score >= minScore && i < seq1length) {
+	if (isMatchVecDone.size() <= blockEnd * scoreMatrixRowSize) {
+	  addBlockLetters(blockEnd);
+	}
+	if (i < seq1length) {  // add a block below, with a vertical path
+	  plusVecs.push_back(~Word(0));
+	  minusVecs.push_back(0);
+	  bottomDists.push_back(bottomDists[k] + blockRows);
+	  ++columnOrigins.back();
+	  ++blockEnd;
+	}
+      }
+    }
+  }
+
+  traceBack();
+  return rescore(differenceCost - halfMatchScore, maxScoreDrop);
+}
+
+void BitVectorXdropAligner::traceBack() {
+  size_t i = bestPos1;
+  size_t j = bestPos2;
+  chunks.clear();
+
+  for (;;) {
+    // skip back past gaps, until we hit a gapless chunk or the start
+    // of the extension:
+    int s;
+    while (i > 0 && j > 0 && (s = step(i, j)) != 0) {
+      if (s == 1) --i;
+      else        --j;
+    }
+    if (i == 0 || j == 0) break;
+
+    Chunk c = {i, j, 0};
+    do {
+      --i;
+      --j;
+    } while (i > 0 && j > 0 && step(i, j) == 0);
+    c.length = c.end1 - i;
+    chunks.push_back(c);
+  }
+
+  std::reverse(chunks.begin(), chunks.end());
+}
+
+int BitVectorXdropAligner::rescore(int gapCost, int maxScoreDrop) const {
+  int score = 0;
+  int maxScore = 0;
+  size_t end1 = 0;
+  size_t end2 = 0;
+  for (size_t k = 0; k < chunks.size(); ++k) {
+    const Chunk &c = chunks[k];
+    size_t beg1 = c.end1 - c.length;
+    size_t beg2 = c.end2 - c.length;
+    score -= gapCost * int(beg1 - end1 + beg2 - end2);
+    if (score < maxScore - maxScoreDrop) return -1;
+    for (size_t x = 0; x < c.length; ++x) {
+      score += scoreMatrix[letter1(beg1 + x)][letter2(beg2 + x)];
+      if (score > maxScore) maxScore = score;
+      else if (score < maxScore - maxScoreDrop) return -1;
+    }
+    end1 = c.end1;
+    end2 = c.end2;
+  }
+  return score;
+}
+
+bool BitVectorXdropAligner::getNextChunk(size_t &end1,
+					 size_t &end2,
+					 size_t &length) {
+  if (chunks.empty()) return false;
+  const Chunk &c = chunks.back();
+  end1 = c.end1;
+  end2 = c.end2;
+  length = c.length;
+  chunks.pop_back();
+  return true;
+}
+
+}
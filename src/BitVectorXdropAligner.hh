@@ -0,0 +1,123 @@
+// Copyright 2026 Martin C. Frith
+
+// These routines extend an alignment in a given direction (forward or
+// reverse) from given start points in two sequences.  They are an
+// alternative to GreedyXdropAligner, with the same interface and
+// scoring scheme: a match score (scorer[0][0]), a mismatch score
+// (scorer[0][1]), and a gap cost of (match score / 2 - mismatch
+// score) per letter.
+
+// With this scheme, an alignment's score is:
+//   (match score / 2) * (i + j)  -  (match score - mismatch score) * d
+// where i and j are the numbers of letters it covers in each
+// sequence, and d is its number of differences (edit distance).  So
+// the best alignment ending at any (i, j) is a minimum-edit-distance
+// alignment, which we get with the bit-vector algorithm of G Myers,
+// J ACM 1999 46(3):395-415, in blocks of 64 rows.
+
+// X-drop: blocks are removed when all their cells score more than
+// maxScoreDrop below the best score so far, and added when the last
+// block's bottom cell scores within maxScoreDrop of the best.  This
+// is coarser than a cell-by-cell X-drop, so the alignment path may
+// dip more than maxScoreDrop below its best prefix: then "align"
+// returns -1, and the caller should use another method.  Otherwise,
+// it returns the path's score, recalculated with the scorer.
+
+// The start points point at the first positions we'll try to align.
+
+// To use: first call "align", which calculates the alignment but only
+// returns its score.  To get the actual alignment, call
+// "getNextChunk" to get each gapless chunk.
+
+// The sequences had better end with delimiter characters.  A letter
+// pair (x, y) is a match if scorer[x][y] > 0.
+
+#ifndef BIT_VECTOR_XDROP_ALIGNER_HH
+#define BIT_VECTOR_XDROP_ALIGNER_HH
+
+#include "ScoreMatrixRow.hh"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cbrc {
+
+typedef unsigned char uchar;
+
+class BitVectorXdropAligner {
+public:
+  int align(const uchar *seq1,  // start point in the 1st sequence
+	    const uchar *seq2,  // start point in the 2nd sequence
+	    bool isForward,  // forward or reverse extension?
+	    const ScoreMatrixRow *scorer,  // the substitution score matrix
+	    int maxScoreDrop,
+	    uchar delimiter);
+
+  // Call this repeatedly to get each gapless chunk of the alignment.
+  // The chunks are returned in far-to-near order.  The chunk's end
+  // coordinates in each sequence (relative to the start of extension)
+  // and length are returned in the 3 out-parameters.  If there are no
+  // more chunks, the 3 parameters are unchanged and "false" is
+  // returned.
+  bool getNextChunk(size_t &end1, size_t &end2, size_t &length);
+
+private:
+  typedef uint64_t Word;
+
+  // For each column (seq2 position) and each block stored for it: the
+  // vertical differences between adjacent rows (+1 or -1), and the
+  // edit distance at the block's bottom row
+  std::vector<Word> plusVecs;
+  std::vector<Word> minusVecs;
+  std::vector<int> bottomDists;
+  std::vector<size_t> columnOrigins;  // where each column's blocks start
+  std::vector<size_t> columnBlockBegs;  // each column's first block
+
+  std::vector<Word> matchVecs;  // which rows of a block match each letter
+  std::vector<char> isMatchVecDone;
+  std::vector<int> blockMaxScores;  // in the current column
+
+  const uchar *seq1beg;
+  const uchar *seq2beg;
+  bool isForwardExtension;
+  const ScoreMatrixRow *scoreMatrix;
+  uchar delimiterLetter;
+  size_t seq1length;  // the number of letters before the delimiter
+
+  size_t bestPos1;  // where the best-scoring cell is
+  size_t bestPos2;
+
+  struct Chunk { size_t end1, end2, length; };
+  std::vector<Chunk> chunks;  // the alignment's chunks, near-to-far
+
+  uchar letter1(size_t i) const
+  { return isForwardExtension ? seq1beg[i] : *(seq1beg - i); }
+
+  uchar letter2(size_t j) const
+  { return isForwardExtension ? seq2beg[j] : *(seq2beg - j); }
+
+  void addBlockLetters(size_t block);  // also finds seq1length
+
+  Word matchVec(size_t block, uchar letter2);
+
+  bool isMatch(size_t i, size_t j) const  // do letters i-1, j-1 match?
+  { return scoreMatrix[letter1(i - 1)][letter2(j - 1)] > 0; }
+
+  bool isKnown(size_t i, size_t j) const;
+
+  int distance(size_t i, size_t j) const;
+
+  // The step into cell (i, j) on a minimum-distance path:
+  // 0=diagonal, 1=vertical (seq1 letter i-1 is unaligned), 2=horizontal
+  int step(size_t i, size_t j) const;
+
+  void traceBack();
+
+  // The alignment's score, or -1 if it dips too low
+  int rescore(int gapCost, int maxScoreDrop) const;
+};
+
+}
+
+#endif
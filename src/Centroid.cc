@@ -9,6 +9,17 @@
 
 static const double DINF = DBL_MAX / 2;
 
+// Copy n letters, starting at seq, going forwards or backwards
+template<typename Ptr>
+static void copySeq(unsigned char *out, Ptr seq, size_t n, bool isForward) {
+  if (isForward) {
+    while (n--) *out++ = getNext(seq);
+  } else {
+    getNext(seq);
+    while (n--) *out++ = getPrev(seq);
+  }
+}
+
 namespace cbrc{
 
   void Centroid::setPssm( const ScoreMatrixRow* pssm, size_t qsize, double T,
@@ -80,9 +91,10 @@ namespace cbrc{
     size_t seqLength1 = xa.seq1start(numAntidiagonals - 1) + 1;
     copyOfSeq1.resize(seqLength1);
     seq1ptr = &copyOfSeq1[0];
-    if (!isExtendFwd) getNext(seq1);
-    for (uchar *s = seq1ptr; seqLength1--; ++s) {
-      *s = isExtendFwd ? getNext(seq1) : getPrev(seq1);
+    if (seq1.is4bit) {
+      copySeq(seq1ptr, nibblePtr(seq1), seqLength1, isExtendFwd);
+    } else {
+      copySeq(seq1ptr, bytePtr(seq1), seqLength1, isExtendFwd);
     }
 
     size_t antidiagonal = 0;
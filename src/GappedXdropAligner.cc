@@ -54,19 +54,20 @@
 
 namespace cbrc {
 
-int GappedXdropAligner::align(BigPtr seq1,
-                              const uchar *seq2,
-                              bool isForward,
-			      int globality,
-                              const ScoreMatrixRow *scorer,
-                              int delExistenceCost,
-                              int delExtensionCost,
-                              int insExistenceCost,
-                              int insExtensionCost,
-                              int gapUnalignedCost,
-			      bool isAffine,
-                              int maxScoreDrop,
-                              int maxMatchScore) {
+template<typename Seq1Ptr>
+int GappedXdropAligner::doAlign(Seq1Ptr seq1,
+				const uchar *seq2,
+				bool isForward,
+				int globality,
+				const ScoreMatrixRow *scorer,
+				int delExistenceCost,
+				int delExtensionCost,
+				int insExistenceCost,
+				int insExtensionCost,
+				int gapUnalignedCost,
+				bool isAffine,
+				int maxScoreDrop,
+				int maxMatchScore) {
   const SimdInt mNegInf = simdFill(-INF);
   const SimdInt mDelOpenCost = simdFill(delExistenceCost);
   const SimdInt mDelGrowCost = simdFill(delExtensionCost);
@@ -197,7 +198,7 @@ int GappedXdropAligner::align(BigPtr seq1,
     horiPos = thisPos - 1;
     thisPos += numCells;
 
-    if (x0[n] > -INF / 2) {
+    if (x0[n] > -INF / 2 && isInBandTop(antidiagonal + 1, seq1end)) {
       ++numCells;
       ++seq1end;
       const int *x = scorer[*seq1];
@@ -206,7 +207,8 @@ int GappedXdropAligner::align(BigPtr seq1,
       isDelimiter1 = isDelimiter(0, pssmQueue.fromEnd(simdLen));
     }
 
-    if (x0[0] > -INF / 2) {
+    if (x0[0] > -INF / 2 &&
+	isInBandBottom(antidiagonal + 1, seq1end - numCells)) {
       uchar y = *seq2;
       seq2queue.push(y, n + simdLen);
       seq2 += seqIncrement;
@@ -229,6 +231,51 @@ int GappedXdropAligner::align(BigPtr seq1,
   return bestScore;
 }
 
+void GappedXdropAligner::setBand(const std::vector<size_t> &points1,
+				 const std::vector<size_t> &points2,
+				 int width) {
+  bandWidth = width;
+  bandDiagonals.clear();
+  size_t a = 0;  // the previous point's antidiagonal
+  long d = 0;  // the previous point's diagonal
+  for (size_t i = 0; i < points1.size(); ++i) {
+    size_t nextA = points1[i] + points2[i];
+    long nextD = long(points1[i]) - long(points2[i]);
+    if (nextA <= a) continue;
+    long span = nextA - a;
+    for (long k = 0; k < span; ++k) {
+      bandDiagonals.push_back(d + (nextD - d) * k / span);
+    }
+    a = nextA;
+    d = nextD;
+  }
+  bandDiagonals.push_back(d);
+}
+
+int GappedXdropAligner::align(BigPtr seq1,
+                              const uchar *seq2,
+                              bool isForward,
+			      int globality,
+                              const ScoreMatrixRow *scorer,
+                              int delExistenceCost,
+                              int delExtensionCost,
+                              int insExistenceCost,
+                              int insExtensionCost,
+                              int gapUnalignedCost,
+			      bool isAffine,
+                              int maxScoreDrop,
+                              int maxMatchScore) {
+  return seq1.is4bit
+    ? doAlign(nibblePtr(seq1), seq2, isForward, globality, scorer,
+	      delExistenceCost, delExtensionCost, insExistenceCost,
+	      insExtensionCost, gapUnalignedCost, isAffine, maxScoreDrop,
+	      maxMatchScore)
+    : doAlign(bytePtr(seq1), seq2, isForward, globality, scorer,
+	      delExistenceCost, delExtensionCost, insExistenceCost,
+	      insExtensionCost, gapUnalignedCost, isAffine, maxScoreDrop,
+	      maxMatchScore);
+}
+
 bool GappedXdropAligner::getNextChunk(size_t &end1,
                                       size_t &end2,
                                       size_t &length,
@@ -74,6 +74,24 @@ const int droppedTinyScore = UCHAR_MAX;
 
 class GappedXdropAligner {
  public:
+  GappedXdropAligner() : bandWidth(-1) {}
+
+  // Restrict subsequent extensions by align, alignPssm, and alignDna
+  // to a band: cells within "width" diagonals of a path through the
+  // given points.  The points are (seq1, seq2) coordinates relative
+  // to the start of extension, in increasing order of both.  Between
+  // points, the path's diagonal is interpolated, and beyond the last
+  // point it stays the same.  A negative width means no band.
+  void setBand(const std::vector<size_t> &points1,
+	       const std::vector<size_t> &points2, int width);
+
+  // Is the cell (pos1, pos2) within "margin" of the band's edge?
+  bool isNearBandEdge(size_t pos1, size_t pos2, int margin) const {
+    if (bandWidth < 0) return false;
+    long d = long(pos1) - long(pos2) - bandDiagonal(pos1 + pos2);
+    return d + margin >= bandWidth || d - margin <= -bandWidth;
+  }
+
   int align(BigPtr seq1,  // start point in the 1st sequence
             const uchar *seq2,  // start point in the 2nd sequence
             bool isForward,  // forward or reverse extension?
@@ -290,6 +308,51 @@ class GappedXdropAligner {
   size_t bestAntidiagonal;
   size_t bestSeq1position;
 
+  std::vector<long> bandDiagonals;  // the band's diagonal per antidiagonal
+  int bandWidth;
+
+  long bandDiagonal(size_t antidiagonal) const {
+    return antidiagonal < bandDiagonals.size() ? bandDiagonals[antidiagonal]
+      : bandDiagonals.empty() ? 0 : bandDiagonals.back();
+  }
+
+  // Can the next antidiagonal gain a cell at seq1 coordinate seq1end,
+  // or keep its cell at seq1 coordinate seq1beg, without leaving the
+  // band?
+  bool isInBandTop(size_t nextAntidiagonal, size_t seq1end) const {
+    return bandWidth < 0 || long(seq1end) * 2 - long(nextAntidiagonal) <=
+      bandDiagonal(nextAntidiagonal) + bandWidth;
+  }
+  bool isInBandBottom(size_t nextAntidiagonal, size_t seq1beg) const {
+    return bandWidth < 0 || long(seq1beg) * 2 - long(nextAntidiagonal) >=
+      bandDiagonal(nextAntidiagonal) - bandWidth;
+  }
+
+  // Versions of align, alignPssm, alignDna, where the 1st sequence's
+  // element size is fixed at compile time (Seq1Ptr = BytePtr or
+  // NibblePtr)
+
+  template<typename Seq1Ptr>
+  int doAlign(Seq1Ptr seq1, const uchar *seq2, bool isForward, int globality,
+	      const ScoreMatrixRow *scorer, int delExistenceCost,
+	      int delExtensionCost, int insExistenceCost,
+	      int insExtensionCost, int gapUnalignedCost, bool isAffine,
+	      int maxScoreDrop, int maxMatchScore);
+
+  template<typename Seq1Ptr>
+  int doAlignPssm(Seq1Ptr seq, const ScoreMatrixRow *pssm, bool isForward,
+		  int globality, int delExistenceCost, int delExtensionCost,
+		  int insExistenceCost, int insExtensionCost,
+		  int gapUnalignedCost, bool isAffine, int maxScoreDrop,
+		  int maxMatchScore);
+
+  template<typename Seq1Ptr>
+  int doAlignDna(Seq1Ptr seq1, const uchar *seq2, bool isForward,
+		 const ScoreMatrixRow *scorer, int delExistenceCost,
+		 int delExtensionCost, int insExistenceCost,
+		 int insExtensionCost, int maxScoreDrop, int maxMatchScore,
+		 const uchar *toUnmasked);
+
   void resizeScoresIfSmaller(size_t size) {
     if (xScores.size() < size) {
       xScores.resize(size);
@@ -14,17 +14,18 @@ const int seqLoadLen = simdBytes;
 
 const int delimiter = 4;
 
-int GappedXdropAligner::alignDna(BigPtr seq1,
-				 const uchar *seq2,
-				 bool isForward,
-				 const ScoreMatrixRow *scorer,
-				 int delOpenCost,
-				 int delGrowCost,
-				 int insOpenCost,
-				 int insGrowCost,
-				 int maxScoreDrop,
-				 int maxMatchScore,
-				 const uchar *toUnmasked) {
+template<typename Seq1Ptr>
+int GappedXdropAligner::doAlignDna(Seq1Ptr seq1,
+				   const uchar *seq2,
+				   bool isForward,
+				   const ScoreMatrixRow *scorer,
+				   int delOpenCost,
+				   int delGrowCost,
+				   int insOpenCost,
+				   int insGrowCost,
+				   int maxScoreDrop,
+				   int maxMatchScore,
+				   const uchar *toUnmasked) {
   int badScoreDrop = maxScoreDrop + 1;
 
   delGrowCost = std::min(delGrowCost, badScoreDrop);
@@ -194,7 +195,8 @@ int GappedXdropAligner::alignDna(BigPtr seq1,
     horiPos = thisPos - 1;
     thisPos += numCells;
 
-    if (x0[n] != droppedTinyScore) {
+    if (x0[n] != droppedTinyScore &&
+	isInBandTop(antidiagonal - 1, seq1end)) {
       ++numCells;
       ++seq1end;
       uchar x = toUnmasked[*seq1];
@@ -206,7 +208,8 @@ int GappedXdropAligner::alignDna(BigPtr seq1,
       }
     }
 
-    if (x0[0] != droppedTinyScore) {
+    if (x0[0] != droppedTinyScore &&
+	isInBandBottom(antidiagonal - 1, seq1end - numCells)) {
       uchar y = toUnmasked[*seq2];
       seq2queue.push(y, n + seqLoadLen);
       seq2 += seqIncrement;
@@ -227,6 +230,26 @@ int GappedXdropAligner::alignDna(BigPtr seq1,
   return bestScore;
 }
 
+int GappedXdropAligner::alignDna(BigPtr seq1,
+				 const uchar *seq2,
+				 bool isForward,
+				 const ScoreMatrixRow *scorer,
+				 int delOpenCost,
+				 int delGrowCost,
+				 int insOpenCost,
+				 int insGrowCost,
+				 int maxScoreDrop,
+				 int maxMatchScore,
+				 const uchar *toUnmasked) {
+  return seq1.is4bit
+    ? doAlignDna(nibblePtr(seq1), seq2, isForward, scorer, delOpenCost,
+		 delGrowCost, insOpenCost, insGrowCost, maxScoreDrop,
+		 maxMatchScore, toUnmasked)
+    : doAlignDna(bytePtr(seq1), seq2, isForward, scorer, delOpenCost,
+		 delGrowCost, insOpenCost, insGrowCost, maxScoreDrop,
+		 maxMatchScore, toUnmasked);
+}
+
 bool GappedXdropAligner::getNextChunkDna(size_t &end1,
 					 size_t &end2,
 					 size_t &length,
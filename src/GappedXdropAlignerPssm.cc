@@ -5,18 +5,19 @@
 
 namespace cbrc {
 
-int GappedXdropAligner::alignPssm(BigPtr seq,
-                                  const ScoreMatrixRow *pssm,
-                                  bool isForward,
-				  int globality,
-				  int delExistenceCost,
-				  int delExtensionCost,
-				  int insExistenceCost,
-				  int insExtensionCost,
-                                  int gapUnalignedCost,
-				  bool isAffine,
-                                  int maxScoreDrop,
-                                  int maxMatchScore) {
+template<typename Seq1Ptr>
+int GappedXdropAligner::doAlignPssm(Seq1Ptr seq,
+				    const ScoreMatrixRow *pssm,
+				    bool isForward,
+				    int globality,
+				    int delExistenceCost,
+				    int delExtensionCost,
+				    int insExistenceCost,
+				    int insExtensionCost,
+				    int gapUnalignedCost,
+				    bool isAffine,
+				    int maxScoreDrop,
+				    int maxMatchScore) {
   const int *vectorOfMatchScores = *pssm;
   const SimdInt mNegInf = simdFill(-INF);
   const SimdInt mDelOpenCost = simdFill(delExistenceCost);
@@ -148,7 +149,7 @@ int GappedXdropAligner::alignPssm(BigPtr seq,
     horiPos = thisPos - 1;
     thisPos += numCells;
 
-    if (x0[n] > -INF / 2) {
+    if (x0[n] > -INF / 2 && isInBandTop(antidiagonal + 1, seq1end)) {
       ++numCells;
       ++seq1end;
       uchar x = *seq;
@@ -158,7 +159,8 @@ int GappedXdropAligner::alignPssm(BigPtr seq,
 				 vectorOfMatchScores);
     }
 
-    if (x0[0] > -INF / 2) {
+    if (x0[0] > -INF / 2 &&
+	isInBandBottom(antidiagonal + 1, seq1end - numCells)) {
       const int *y = *pssm;
       pssmQueue.push(y, n + simdLen);
       pssm += seqIncrement;
@@ -181,4 +183,27 @@ int GappedXdropAligner::alignPssm(BigPtr seq,
   return bestScore;
 }
 
+int GappedXdropAligner::alignPssm(BigPtr seq,
+                                  const ScoreMatrixRow *pssm,
+                                  bool isForward,
+				  int globality,
+				  int delExistenceCost,
+				  int delExtensionCost,
+				  int insExistenceCost,
+				  int insExtensionCost,
+                                  int gapUnalignedCost,
+				  bool isAffine,
+                                  int maxScoreDrop,
+                                  int maxMatchScore) {
+  return seq.is4bit
+    ? doAlignPssm(nibblePtr(seq), pssm, isForward, globality,
+		  delExistenceCost, delExtensionCost, insExistenceCost,
+		  insExtensionCost, gapUnalignedCost, isAffine, maxScoreDrop,
+		  maxMatchScore)
+    : doAlignPssm(bytePtr(seq), pssm, isForward, globality,
+		  delExistenceCost, delExtensionCost, insExistenceCost,
+		  insExtensionCost, gapUnalignedCost, isAffine, maxScoreDrop,
+		  maxMatchScore);
+}
+
 }
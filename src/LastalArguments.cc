@@ -53,6 +53,9 @@ static char parseOutputFormat( const char* text ){
   if( s == "maf" || s == "1" ) return 'm';
   if( s == "blasttab" )        return 'b';
   if( s == "blasttab+" )       return 'B';
+  if( s == "sam" )             return 's';
+  if( s == "bam" )             return 'S';
+  if( s == "paf" )             return 'p';
   return 0;
 }
 
@@ -76,6 +79,7 @@ LastalArguments::LastalArguments() :
   strand(-1),  // depends on the alphabet
   isQueryStrandMatrix(false),
   isGreedy(false),
+  isBitVector(false),
   globality(0),
   isKeepLowercase(true),  // depends on the option used with lastdb
   tantanSetting(-1),  // depends on the option used with lastdb
@@ -98,14 +102,20 @@ LastalArguments::LastalArguments() :
   minHitDepth(1),
   maxHitDepth(-1),
   oneHitMultiplicity(10),
+  maxBucketHits(-1),
   maxGaplessAlignmentsPerQueryPosition(0),  // depends on oneHitMultiplicity
   maxAlignmentsPerQueryStrand(-1),
   cullingLimitForGaplessAlignments(0),
+  maxChainGap(0),  // this means: OFF
+  bandWidth(-1),  // this means: OFF
   cullingLimitForFinalAlignments(-1),
   queryStep(1),
   minimizerWindow(0),  // depends on the reference's minimizer window
   batchSize(0),  // depends on voluming
+  isSortQueries(false),
   numOfThreads(1),
+  querySplitLength(0),  // this means: OFF
+  dupCacheSize(0),  // this means: OFF
   maxRepeatDistance(1000),  // sufficiently conservative?
   temperature(-1),  // depends on the score matrix
   gamma(1),
@@ -125,7 +135,8 @@ Cosmetic options:\n\
  -h, --help     show all options and their default settings, and exit\n\
  -V, --version  show version information, and exit\n\
  -v             be verbose: write messages about what lastal is doing\n\
- -f             output format: TAB, MAF, BlastTab, BlastTab+ (default: MAF)";
+ -f             output format: TAB, MAF, BlastTab, BlastTab+, SAM, BAM, PAF\n\
+                (default: MAF)";
 
   std::string help = usage + "\n\
 \n\
@@ -161,6 +172,8 @@ Initial-match options (default settings):\n\
  -k  use initial matches starting at every k-th position in each query ("
     + stringify(queryStep) + ")\n\
  -W  use \"minimum\" positions in sliding windows of W consecutive positions\n\
+ --max-bucket-hits=H  skip initial matches whose first b letters (b = lastdb\n\
+                      bucket length) occur > H times in the reference (off)\n\
 \n\
 Miscellaneous options (default settings):\n\
  -s  strand: 0=reverse, 1=forward, 2=both (2 if DNA and not lastdb -S2, else 1)\n\
@@ -168,10 +181,22 @@ Miscellaneous options (default settings):\n\
     + stringify(isQueryStrandMatrix) + ")\n\
  -K  omit alignments whose query range lies in >= K others with > score (off)\n\
  -C  omit gapless alignments in >= C others with > score-per-length (off)\n\
+ --chain=G  chain colinear gapless alignments with gaps <= G: don't extend\n\
+            chains with total score < e, or ones inside a chain-mate's\n\
+            gapped alignment (off)\n\
+ --band=W  do gapped extension within W diagonals of the chain, falling back\n\
+           to unbanded extension if the alignment nears the band edge (off)\n\
  -P  number of parallel threads ("
     + stringify(numOfThreads) + ")\n\
+ --split-query=L  with -P: find seeds & gapless alignments of queries longer\n\
+                  than L with several threads (off)\n\
+ --dup-cache=B  remember alignments of recent queries, using up to B bytes,\n\
+                and reuse them for exact duplicate queries (off)\n\
  -i  query batch size (64M if multi-volume, else off)\n\
+ --sort-queries  with batches: align each batch's queries in the index order\n\
+                 of their first seeds, for faster memory access (off)\n\
  -M  find minimum-difference alignments (faster but cruder)\n\
+ --bit-vector  with -M: find them with a bit-parallel edit-distance algorithm\n\
  -T  type of alignment: 0=local, 1=overlap ("
     + stringify(globality) + ")\n\
  -n  maximum gapless alignments per query position (infinity if m=0, else m)\n\
@@ -219,6 +244,13 @@ Split options:\n\
     { "version", no_argument,       0, 'V' },
     { "gumbel-len", required_argument, 0, 'L' - 'A' },
     { "gumbel-num", required_argument, 0, 'N' - 'A' },
+    { "chain",   required_argument, 0, 'H' - 'A' },
+    { "band",    required_argument, 0, 'I' - 'A' },
+    { "bit-vector", no_argument,    0, 'J' - 'A' },
+    { "split-query", required_argument, 0, 'K' - 'A' },
+    { "dup-cache", required_argument, 0, 'D' - 'A' },
+    { "sort-queries", no_argument,  0, 'E' - 'A' },
+    { "max-bucket-hits", required_argument, 0, 'F' - 'A' },
     { "split",   no_argument,       0, 128 + 0 },
     { "splice",  no_argument,       0, 128 + 1 },
     { "split-f", required_argument, 0, 128 + 'f' },
@@ -414,6 +446,31 @@ Split options:\n\
       unstringify(gumbelSimAlignmentCount, optarg);
       if (gumbelSimAlignmentCount <= 0) badopt(lOpts[lOptsIndex].name, optarg);
       break;
+    case 'H' - 'A':
+      unstringify(maxChainGap, optarg);
+      if (maxChainGap < 1) badopt(lOpts[lOptsIndex].name, optarg);
+      break;
+    case 'J' - 'A':
+      isBitVector = true;
+      break;
+    case 'I' - 'A':
+      unstringify(bandWidth, optarg);
+      if (bandWidth < 1) badopt(lOpts[lOptsIndex].name, optarg);
+      break;
+    case 'K' - 'A':
+      unstringifySize(querySplitLength, optarg);
+      if (querySplitLength < 1) badopt(lOpts[lOptsIndex].name, optarg);
+      break;
+    case 'F' - 'A':
+      unstringify(maxBucketHits, optarg);
+      break;
+    case 'E' - 'A':
+      isSortQueries = true;
+      break;
+    case 'D' - 'A':
+      unstringifySize(dupCacheSize, optarg);
+      if (dupCacheSize < 1) badopt(lOpts[lOptsIndex].name, optarg);
+      break;
 
     case 128 + 1:
       splitOpts.isSplicedAlignment = true;
@@ -494,6 +551,9 @@ Split options:\n\
   if( gapPairCost > 0 && outputType > 3 )
     ERR( "can't combine option -c with option -j > 3" );
 
+  if (bandWidth > 0 && !maxChainGap) ERR("option --band needs option --chain");
+  if (isBitVector && !isGreedy) ERR("option --bit-vector needs option -M");
+
   if( !optionsOnly ){
     if( optind >= argc )
       ERR( "please give me a database name and sequence file(s)\n\n" + usage );
@@ -678,8 +738,11 @@ To proceed without E-values, set a score threshold with option -e.");
   }
 
   if (isSplit) {
-    if (outputFormat != 'm')
+    if (splitOpts.format == 's' || splitOpts.format == 'S')
+      outputFormat = splitOpts.format;
+    if (outputFormat != 'm' && !isSam())
       ERR("can't do split alignment with non-MAF output");
+    if (isSam()) splitOpts.format = outputFormat;
     if (isTranslated())
       ERR("can't do split DNA-protein alignment");
     if (gapPairCost > 0)
@@ -687,6 +750,20 @@ To proceed without E-values, set a score threshold with option -e.");
     if (verbosity > 1) splitOpts.verbose = true;
     splitOpts.setUnspecifiedValues(minScoreGapped, temperature);
   }
+
+  if (isSam()) {
+    if (isTranslated())
+      ERR("can't write SAM/BAM for DNA-protein alignment");
+    if (outputType == 0)
+      ERR("can't write SAM/BAM with option -j0");
+  }
+
+  if (isPaf()) {
+    if (isTranslated())
+      ERR("can't write PAF for DNA-protein alignment");
+    if (outputType == 0)
+      ERR("can't write PAF with option -j0");
+  }
 }
 
 void LastalArguments::writeCommented( std::ostream& stream ) const{
@@ -46,6 +46,10 @@ struct LastalArguments{
   // write the parameter settings, starting each line with "#":
   void writeCommented( std::ostream& stream ) const;
 
+  // is the output format SAM or BAM?
+  bool isSam() const { return outputFormat == 's' || outputFormat == 'S'; }
+  bool isPaf() const { return outputFormat == 'p'; }
+
   // are we doing translated alignment (DNA versus protein)?
   bool isTranslated() const { return !frameshiftCosts.empty(); }
 
@@ -80,6 +84,7 @@ struct LastalArguments{
   int strand;
   bool isQueryStrandMatrix;
   bool isGreedy;
+  bool isBitVector;  // do -M extensions with a bit-vector algorithm
   int globality;  // type of alignment: local, semi-global, etc.
   bool isKeepLowercase;
   int tantanSetting;
@@ -107,14 +112,20 @@ struct LastalArguments{
   size_t minHitDepth;
   size_t maxHitDepth;
   size_t oneHitMultiplicity;
+  size_t maxBucketHits;  // skip initial matches with more hits at bucket depth
   size_t maxGaplessAlignmentsPerQueryPosition;
   size_t maxAlignmentsPerQueryStrand;
   size_t cullingLimitForGaplessAlignments;
+  size_t maxChainGap;  // chain gapless alignments with gaps <= this
+  int bandWidth;  // gapped extension near the chain, or -1: X-drop only
   size_t cullingLimitForFinalAlignments;
   size_t queryStep;
   size_t minimizerWindow;
   size_t batchSize;  // approx size of query sequences to scan in 1 batch
+  bool isSortQueries;  // process each batch's queries in index order
   unsigned numOfThreads;
+  size_t querySplitLength;  // seed longer queries with several threads
+  size_t dupCacheSize;  // bytes of alignments to reuse for duplicate queries
   size_t maxRepeatDistance;  // suppress repeats <= this distance apart
   double temperature;  // probability = exp( score / temperature ) / Z
   double gamma;        // parameter for gamma-centroid alignment
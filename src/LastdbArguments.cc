@@ -29,6 +29,8 @@ LastdbArguments::LastdbArguments() :
   seedPatterns(0),
   strand(1),
   volumeSize(-1),
+  readAheadSize(0),
+  sortMemory(0),
   indexStep(1),
   minimizerWindow(1),
   numOfThreads(1),
@@ -36,9 +38,11 @@ LastdbArguments::LastdbArguments() :
   userAlphabet(""),
   minSeedLimit(0),
   bucketDepth(-1),  // means: use the default (adapts to the data)
+  prefixCacheWidth(0),
   minIndexedPositionsPerBucket(4),
   childTableType(0),
   isCountsOnly(false),
+  isAppend(false),
   isDump(false),
   verbosity(0),
   inputFormat(sequenceFormat::fasta),
@@ -85,6 +89,14 @@ Advanced Options (default settings):\n\
  -D  print all sequences in lastdb files\n\
  --bits=N  use this many bits per base for DNA sequence ("
     + stringify(bitsPerBase) + ")\n\
+ --read-ahead=B  read up to B bytes of the next volume's sequences while\n\
+                 making the current volume (" + stringify(readAheadSize) + ")\n\
+ --sort-memory=B  sort the index in parts of about B bytes, writing each part\n\
+                  to disk when it's done (0 means: sort it all at once)\n\
+ --prefix-cache=N  store N letter-subsets of each indexed suffix after its\n\
+                   bucket prefix, to make lastal faster ("
+    + stringify(prefixCacheWidth) + ")\n\
+ --append  add volumes for more sequences to an existing multi-volume database\n\
  -v  be verbose: write messages about what lastdb is doing\n\
  -V, --version  show version information, and exit\n\
 ";
@@ -95,6 +107,10 @@ Advanced Options (default settings):\n\
     { "help",    no_argument, 0, 'h' },
     { "version", no_argument, 0, 'V' },
     { "bits",    required_argument, 0, 128 },
+    { "read-ahead", required_argument, 0, 129 },
+    { "append",  no_argument, 0, 130 },
+    { "prefix-cache", required_argument, 0, 131 },
+    { "sort-memory", required_argument, 0, 132 },
     { 0, 0, 0, 0 }
   };
 
@@ -188,6 +204,18 @@ Advanced Options (default settings):\n\
       if (bitsPerBase != 4 &&
 	  bitsPerBase != 8) badopt(lOpts[optionIndex].name, optarg);
       break;
+    case 129:
+      unstringifySize(readAheadSize, optarg);
+      break;
+    case 130:
+      isAppend = true;
+      break;
+    case 131:
+      unstringify(prefixCacheWidth, optarg);
+      break;
+    case 132:
+      unstringifySize(sortMemory, optarg);
+      break;
     case '?':
       ERR( "bad option" );
     }
@@ -197,6 +225,13 @@ Advanced Options (default settings):\n\
     ERR("can't use --bits=4 with non-default alphabet");
   }
 
+  if (isAppend && isCountsOnly) ERR("can't use --append with -x");
+
+  if (sortMemory && childTableType) ERR("can't use --sort-memory with -C");
+  if (sortMemory && minSeedLimit > 1) {
+    ERR("can't use --sort-memory with -i > 1");
+  }
+
   if( !isOptionsOnly ){
     if( optind >= argc )
       ERR( "please give me an output name and sequence file(s)\n\n" + usage );
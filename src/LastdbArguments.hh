@@ -43,6 +43,8 @@ struct LastdbArguments{
   std::vector< std::string > dnaSeedPatterns;
   int strand;
   size_t volumeSize;
+  size_t readAheadSize;
+  size_t sortMemory;
   size_t indexStep;
   size_t minimizerWindow;
   unsigned numOfThreads;
@@ -50,9 +52,11 @@ struct LastdbArguments{
   std::string userAlphabet;
   size_t minSeedLimit;
   unsigned bucketDepth;
+  size_t prefixCacheWidth;
   size_t minIndexedPositionsPerBucket;
   int childTableType;
   bool isCountsOnly;
+  bool isAppend;
   bool isDump;
   int verbosity;
   sequenceFormat::Enum inputFormat;
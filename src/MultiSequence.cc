@@ -2,8 +2,10 @@
 
 #include "MultiSequence.hh"
 #include "io.hh"
+#include "mcf_get_area.hh"
 #include <sstream>
 #include <cassert>
+#include <cstring>  // memchr
 #include <streambuf>
 
 using namespace cbrc;
@@ -37,9 +39,58 @@ void MultiSequence::reinitForAppending(){
   }
 }
 
-void MultiSequence::fromFiles(const std::string &baseName, size_t seqCount,
-			      size_t qualitiesPerLetter, bool is4bit,
-			      bool isSmallCoords) {
+void MultiSequence::reinitFrom(const MultiSequence &m, size_t seqNum) {
+  padSize = m.padSize;
+  qualityScoresPerLetter = m.qualityScoresPerLetter;
+  isReadingFastq = m.isReadingFastq;
+  isAppendingStopSymbol = m.isAppendingStopSymbol;
+  pssmColumnLetters = m.pssmColumnLetters;
+
+  size_t s = m.padBeg(seqNum);
+  size_t n = m.nameEnds.v[seqNum];
+
+  seq.v.assign(m.seq.v.begin() + s, m.seq.v.end());
+  names.v.assign(m.names.v.begin() + n, m.names.v.end());
+
+  ends.v.clear();
+  for (size_t i = seqNum; i < m.ends.v.size(); ++i) {
+    ends.v.push_back(m.ends.v[i] - s);
+  }
+
+  nameEnds.v.clear();
+  for (size_t i = seqNum; i < m.nameEnds.v.size(); ++i) {
+    nameEnds.v.push_back(m.nameEnds.v[i] - n);
+  }
+
+  qualityScores.v.assign(m.qualityScores.v.begin() + s * qualsPerLetter(),
+			 m.qualityScores.v.end());
+
+  if (!m.pssm.empty()) {
+    pssm.assign(m.pssm.begin() + s * scoreMatrixRowSize, m.pssm.end());
+  } else {
+    pssm.clear();
+  }
+}
+
+void MultiSequence::swap(MultiSequence &m) {
+  std::swap(padSize, m.padSize);
+  seq.swap(m.seq);
+  ends.swap(m.ends);
+  names.swap(m.names);
+  nameEnds.swap(m.nameEnds);
+  std::swap(theSeqPtr, m.theSeqPtr);
+  ends4.swap(m.ends4);
+  nameEnds4.swap(m.nameEnds4);
+  pssm.swap(m.pssm);
+  pssmColumnLetters.swap(m.pssmColumnLetters);
+  qualityScores.swap(m.qualityScores);
+  std::swap(qualityScoresPerLetter, m.qualityScoresPerLetter);
+  std::swap(isReadingFastq, m.isReadingFastq);
+  std::swap(isAppendingStopSymbol, m.isAppendingStopSymbol);
+}
+
+void MultiSequence::namesFromFiles(const std::string &baseName,
+				   size_t seqCount, bool isSmallCoords) {
   if (isSmallCoords) {
     ends4.m.open(baseName + ".ssp", seqCount + 1);
     nameEnds4.m.open(baseName + ".sds", seqCount + 1);
@@ -47,44 +98,105 @@ void MultiSequence::fromFiles(const std::string &baseName, size_t seqCount,
     ends.m.open(baseName + ".ssp", seqCount + 1);
     nameEnds.m.open(baseName + ".sds", seqCount + 1);
   }
+  names.m.open(baseName + ".des", getNameEnd(seqCount));
+  padSize = getEnd(0);
+}
+
+void MultiSequence::fromFiles(const std::string &baseName, size_t seqCount,
+			      size_t qualitiesPerLetter, bool is4bit,
+			      bool isSmallCoords) {
+  namesFromFiles(baseName, seqCount, isSmallCoords);
 
   size_t seqLength = getEnd(seqCount);
   seq.m.open(baseName + ".tis", (seqLength + is4bit) / (is4bit + 1));
   theSeqPtr.beg = seq.m.begin();
   theSeqPtr.is4bit = is4bit;
-  names.m.open(baseName + ".des", getNameEnd(seqCount));
-  padSize = getEnd(0);
 
   qualityScores.m.open(baseName + ".qua", seqLength * qualitiesPerLetter);
   qualityScoresPerLetter = qualitiesPerLetter;
 }
 
-void MultiSequence::toFiles(const std::string &baseName, bool is4bit) const {
-  memoryToBinaryFile( ends.begin(), ends.end(), baseName + ".ssp" );
+void MultiSequence::toFiles(const std::string &baseName, bool is4bit,
+			    size_t numOfThreads) const {
+  std::vector<MemoryFile> files;
+
+  addMemoryFile( files, seq.begin(),
+		 seq.begin() + (ends.back() + is4bit) / (is4bit + 1),
+		 baseName + ".tis" );
 
-  memoryToBinaryFile( seq.begin(),
-		      seq.begin() + (ends.back() + is4bit) / (is4bit + 1),
-		      baseName + ".tis" );
+  addMemoryFile( files, qualityScores.begin(),
+		 qualityScores.begin() + ends.back() * qualsPerLetter(),
+		 baseName + ".qua" );
 
-  memoryToBinaryFile( nameEnds.begin(), nameEnds.begin() + ends.size(),
-		      baseName + ".sds" );
+  addMemoryFile( files, ends.begin(), ends.end(), baseName + ".ssp" );
 
-  memoryToBinaryFile( names.begin(),
-		      names.begin() + nameEnds[ finishedSequences() ],
-		      baseName + ".des" );
+  addMemoryFile( files, nameEnds.begin(), nameEnds.begin() + ends.size(),
+		 baseName + ".sds" );
 
-  memoryToBinaryFile( qualityScores.begin(),
-                      qualityScores.begin() + ends.back() * qualsPerLetter(),
-                      baseName + ".qua" );
+  addMemoryFile( files, names.begin(),
+		 names.begin() + nameEnds[ finishedSequences() ],
+		 baseName + ".des" );
+
+  memoryToBinaryFiles( files, numOfThreads );
 }
 
 void MultiSequence::readFastxName(std::istream& stream) {
-  std::string line, a;
+  std::string line;
   getline(stream, line);
   if (!stream) return;
-  std::istringstream iss(line);
-  iss >> a;
-  addName(a);
+  const char *space = " \t\n\v\f\r";
+  size_t beg = line.find_first_not_of(space);
+  if (beg == std::string::npos) beg = line.size();
+  size_t end = line.find_first_of(space, beg);
+  if (end == std::string::npos) end = line.size();
+  addName(line.substr(beg, end - beg));
+}
+
+void MultiSequence::appendLetters(std::streambuf *buf, char stopChar,
+				  size_t maxSeqLen) {
+  int c = buf->sgetc();
+
+  while (c != std::streambuf::traits_type::eof()) {
+    const char *beg = mcf::GetArea::beg(buf);
+    const char *end = mcf::GetArea::end(buf);
+
+    if (beg == end) {  // unbuffered input: get one char at a time
+      if (c > ' ') {  // faster than isspace
+	if (c == stopChar || seq.v.size() >= maxSeqLen) break;
+	seq.v.push_back(c);
+      }
+      c = buf->snextc();
+      continue;
+    }
+
+    const char *stop = (const char *)memchr(beg, stopChar, end - beg);
+    if (stop) end = stop;
+    size_t room = maxSeqLen - std::min(maxSeqLen, seq.v.size());
+    size_t oldSize = seq.v.size();
+    seq.v.resize(oldSize + (end - beg));
+    uchar *out = &seq.v[oldSize];
+    size_t n = 0;
+    const char *p = beg;
+    if (size_t(end - beg) <= room) {
+      for (; p < end; ++p) {  // copy letters without branching
+	uchar x = *p;
+	out[n] = x;
+	n += (x > ' ');
+      }
+    } else {
+      for (; p < end; ++p) {
+	uchar x = *p;
+	if (x > ' ') {
+	  if (n == room) break;
+	  out[n++] = x;
+	}
+      }
+    }
+    seq.v.resize(oldSize + n);
+    mcf::GetArea::skip(buf, p - beg);
+    if (p < end || p == stop) break;
+    c = buf->sgetc();
+  }
 }
 
 std::istream&
@@ -98,16 +210,7 @@ MultiSequence::appendFromFasta(std::istream &stream, size_t maxSeqLen) {
     if( !stream ) return stream;
   }
 
-  std::streambuf *buf = stream.rdbuf();
-  int c = buf->sgetc();
-
-  while (c != std::streambuf::traits_type::eof()) {
-    if (c > ' ') {  // faster than isspace
-      if (c == '>' || seq.v.size() >= maxSeqLen) break;
-      seq.v.push_back(c);
-    }
-    c = buf->snextc();
-  }
+  appendLetters(stream.rdbuf(), '>', maxSeqLen);
 
   if (seq.v.size() <= maxSeqLen &&
       padSize + isAppendingStopSymbol <= maxSeqLen - seq.v.size()) {
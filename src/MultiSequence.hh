@@ -29,18 +29,25 @@ class MultiSequence{
   // re-initialize, but keep the last sequence if it is unfinished
   void reinitForAppending();
 
-  void eraseAllButTheLastSequence() {
-    ends.v.pop_back();
-    reinitForAppending();
-    ends.v.push_back(seq.v.size());
-  }
+  // re-initialize, keeping a copy of m's sequences from seqNum onwards
+  // (which may include an unfinished sequence)
+  void reinitFrom(const MultiSequence &m, size_t seqNum);
+
+  void swap(MultiSequence &m);
 
   // read seqCount finished sequences, and their names, from binary files
   void fromFiles(const std::string &baseName, size_t seqCount,
 		 size_t qualitiesPerLetter, bool is4bit, bool isSmallCoords);
 
-  // write all the finished sequences and their names to binary files
-  void toFiles(const std::string &baseName, bool is4bit) const;
+  // read seqCount finished sequences' names and coordinates, but not
+  // the sequences themselves, from binary files
+  void namesFromFiles(const std::string &baseName, size_t seqCount,
+		      bool isSmallCoords);
+
+  // write all the finished sequences and their names to binary
+  // files, writing up to numOfThreads files at once
+  void toFiles(const std::string &baseName, bool is4bit,
+	       size_t numOfThreads) const;
 
   // Append a sequence with delimiters.  Don't let the total size of
   // the concatenated sequences plus pads exceed maxSeqLen: thus it
@@ -147,13 +154,6 @@ class MultiSequence{
     }
   }
 
-  void convertTo8bit() {
-    uchar *s = &seq.v[0];
-    size_t e = ends.back();
-    size_t i = e / 2 + e % 2;
-    while (i-- > 0) s[i] = mcf::BigSeq::from4bit(s, i);
-  }
-
  private:
   size_t padSize;  // number of delimiter chars between sequences
   VectorOrMmap<uchar> seq;  // concatenated sequences
@@ -183,6 +183,11 @@ class MultiSequence{
   // 1st word
   void readFastxName( std::istream& stream );
 
+  // Append letters (non-whitespace chars) to the last sequence, up
+  // to the next stopChar or the end of input, or until the sequences
+  // reach maxSeqLen
+  void appendLetters(std::streambuf *buf, char stopChar, size_t maxSeqLen);
+
   // read the letters above PSSM columns, so we know which column is which
   std::istream& readPssmHeader( std::istream& stream );
 
@@ -1,9 +1,11 @@
 // Copyright 2009, 2010, 2011, 2013 Martin C. Frith
 
 #include "MultiSequence.hh"
+#include "mcf_get_area.hh"
 #include "stringify.hh"
 #include <algorithm>  // max_element
 #include <cctype>  // toupper
+#include <cstring>  // memchr
 #include <limits>  // numeric_limits
 #include <streambuf>
 
@@ -32,6 +34,71 @@ MultiSequence::appendFromFastx(std::istream &stream, size_t maxSeqLen,
     appendFromFasta(stream, maxSeqLen);
 }
 
+// Read up to and including the next newline
+static void skipLine(std::streambuf *buf) {
+  int c;
+  do {
+    const char *beg = mcf::GetArea::beg(buf);
+    const char *end = mcf::GetArea::end(buf);
+    const char *p = (const char *)memchr(beg, '\n', end - beg);
+    if (p) {
+      mcf::GetArea::skip(buf, p + 1 - beg);
+      return;
+    }
+    mcf::GetArea::skip(buf, end - beg);
+    c = buf->sbumpc();
+  } while (c != std::streambuf::traits_type::eof() && c != '\n');
+}
+
+// Read the next n non-whitespace chars, and maybe append them to "out"
+static void readQualityCodes(std::streambuf *buf, size_t n,
+			     std::vector<uchar> &out, bool isKeep) {
+  while (n > 0) {
+    const char *beg = mcf::GetArea::beg(buf);
+    const char *end = mcf::GetArea::end(buf);
+    if (beg == end) {  // unbuffered input: get one char at a time
+      int c = buf->sbumpc();
+      if (c == std::streambuf::traits_type::eof()) ERR("bad FASTQ data");
+      if (c > ' ') {
+	if (isKeep) {
+	  if (c > 126) ERR("non-printable-ASCII in FASTQ quality data");
+	  out.push_back(c);
+	}
+	--n;
+      }
+      continue;
+    }
+    const char *p = beg;
+    size_t m = std::min(n, size_t(end - beg));
+    int isSpace = 0;
+    int isBad = 0;
+    for (size_t i = 0; i < m; ++i) {  // check without branching
+      uchar c = beg[i];
+      isSpace |= (c <= ' ');
+      isBad |= (c > 126);
+    }
+    if (!isSpace) {
+      if (isKeep) {
+	if (isBad) ERR("non-printable-ASCII in FASTQ quality data");
+	out.insert(out.end(), beg, beg + m);
+      }
+      p += m;
+      n -= m;
+    }
+    for (; p < end && n > 0; ++p) {  // the slow way, if there's whitespace
+      uchar c = *p;
+      if (c > ' ') {
+	if (isKeep) {
+	  if (c > 126) ERR("non-printable-ASCII in FASTQ quality data");
+	  out.push_back(c);
+	}
+	--n;
+      }
+    }
+    mcf::GetArea::skip(buf, p - beg);
+  }
+}
+
 std::istream&
 MultiSequence::appendFromFastq(std::istream &stream, size_t maxSeqLen,
 			       bool isKeepQualityData) {
@@ -48,33 +115,12 @@ MultiSequence::appendFromFastq(std::istream &stream, size_t maxSeqLen,
   }
 
   std::streambuf *buf = stream.rdbuf();
-  int c = buf->sgetc();
-
-  while (c != std::streambuf::traits_type::eof()) {
-    if (c > ' ') {
-      if (c == '+' || seq.v.size() >= maxSeqLen) break;
-      seq.v.push_back(c);
-    }
-    c = buf->snextc();
-  }
+  appendLetters(buf, '+', maxSeqLen);
 
   if (isRoomToAppendPad(maxSeqLen)) {
-    do {
-      c = buf->sbumpc();
-    } while (c != std::streambuf::traits_type::eof() && c != '\n');
-
-    for (size_t i = seq.v.size() - ends.v.back(); i > 0; ) {
-      c = buf->sbumpc();
-      if (c == std::streambuf::traits_type::eof()) ERR("bad FASTQ data");
-      if (c > ' ') {
-	if (isKeepQualityData) {
-	  if (c > 126) ERR("non-printable-ASCII in FASTQ quality data");
-	  qualityScores.v.push_back(c);
-	}
-	--i;
-      }
-    }
-
+    skipLine(buf);
+    readQualityCodes(buf, seq.v.size() - ends.v.back(),
+		     qualityScores.v, isKeepQualityData);
     finish();
     appendQualPad();
   }
@@ -1,6 +1,7 @@
 // Copyright 2008, 2010, 2014 Martin C. Frith
 
 #include "SegmentPairPot.hh"
+#include "MultiSequence.hh"
 #include <cassert>
 
 // Check if n1/d1 < n2/d2, without overflow.
@@ -87,6 +88,117 @@ void SegmentPairPot::sort(){
   std::sort( iters.begin(), iters.end(), iterLess );
 }
 
+static bool beg2Less( const SegmentPair* x, const SegmentPair* y ){
+  return x->beg2() != y->beg2() ? x->beg2() < y->beg2()
+    :                             x->beg1() < y->beg1();
+}
+
+static bool itemBeg2Less( const SegmentPair& x, const SegmentPair& y ){
+  return beg2Less( &x, &y );
+}
+
+// sort item numbers by chain score (in descending order)
+struct ChainEndLess{
+  explicit ChainEndLess( const std::vector<long>& s ) : scores( s ) {}
+  bool operator()( size_t x, size_t y ) const{ return scores[x] > scores[y]; }
+  const std::vector<long>& scores;
+};
+
+void SegmentPairPot::chain( size_t maxGap, const MultiSequence& seqs1 ){
+  // Sparse dynamic programming, in order of query start, looking back
+  // at a limited number of previous items.  Then, starting from the
+  // best chain ends, trace back each chain until it meets an item
+  // already used by a better chain, so that each item belongs to
+  // exactly one colinear chain.
+
+  const size_t maxPredecessors = 50;
+  size_t n = items.size();
+  std::vector<const SegmentPair*> order( n );
+  std::vector<size_t> seqNums( n );  // which sequence of seqs1 each item is in
+  size_t maxSize = 0;
+  for( size_t i = 0; i < n; ++i ){
+    order[i] = &items[i];
+    seqNums[i] = seqs1.whichSequence( items[i].beg1() );
+    if( items[i].size > maxSize ) maxSize = items[i].size;
+  }
+  std::sort( order.begin(), order.end(), beg2Less );
+
+  std::vector<long> bestScores( n );
+  std::vector<size_t> prevs( n );  // each item's predecessor, or n
+
+  for( size_t j = 0; j < n; ++j ){
+    const SegmentPair& y = *order[j];
+    size_t yNum = &y - &items[0];
+    long bestScore = 0;
+    size_t bestNum = n;
+    size_t checked = 0;
+    for( size_t i = j; i-- > 0 && checked < maxPredecessors; ){
+      const SegmentPair& x = *order[i];
+      if( x.beg2() + maxSize + maxGap < y.beg2() ) break;
+      if( x.beg2() == y.beg2() ) continue;
+      ++checked;
+      if( x.beg1() >= y.beg1() || x.end1() > y.end1() ||
+	  x.end2() > y.end2() ) continue;
+      if( y.beg1() > x.end1() + maxGap ) continue;
+      if( y.beg2() > x.end2() + maxGap ) continue;
+      size_t xNum = &x - &items[0];
+      if( seqNums[xNum] != seqNums[yNum] ) continue;
+      if( bestScores[xNum] > bestScore ){
+	bestScore = bestScores[xNum];
+	bestNum = xNum;
+      }
+    }
+    bestScores[yNum] = bestScore + y.score;
+    prevs[yNum] = bestNum;
+  }
+
+  std::vector<size_t> ends( n );
+  for( size_t i = 0; i < n; ++i ) ends[i] = i;
+  std::stable_sort( ends.begin(), ends.end(), ChainEndLess( bestScores ) );
+
+  // each chain is a circular list, whose items get the chain's score
+  chainLinks.assign( n, n );
+  chainScores.resize( n );
+  for( size_t e = 0; e < n; ++e ){
+    size_t i = ends[e];
+    if( chainLinks[i] < n ) continue;  // already in a better chain
+    long total = 0;
+    size_t j = i;
+    while( true ){
+      total += items[j].score;
+      size_t p = prevs[j];
+      if( p == n || chainLinks[p] < n ) break;
+      chainLinks[j] = p;
+      j = p;
+    }
+    chainLinks[j] = i;
+    j = i;
+    do{ chainScores[j] = total; j = chainLinks[j]; }while( j != i );
+  }
+}
+
+void SegmentPairPot::markChainMates( const SegmentPair& sp,
+				     size_t beg1, size_t end1,
+				     size_t beg2, size_t end2 ){
+  size_t start = &sp - &items[0];
+  for( size_t i = chainLinks[start]; i != start; i = chainLinks[i] ){
+    SegmentPair& x = items[i];
+    if( x.beg1() >= beg1 && x.end1() <= end1 &&
+	x.beg2() >= beg2 && x.end2() <= end2 ) mark( x );
+  }
+}
+
+void SegmentPairPot::getChain( const SegmentPair& sp,
+			       std::vector<SegmentPair>& chainItems ) const{
+  size_t start = &sp - &items[0];
+  chainItems.clear();
+  chainItems.push_back( sp );
+  for( size_t i = chainLinks[start]; i != start; i = chainLinks[i] ){
+    chainItems.push_back( items[i] );
+  }
+  std::sort( chainItems.begin(), chainItems.end(), itemBeg2Less );
+}
+
 void SegmentPairPot::markOverlaps( const SegmentPair& sp ){
   iterator i = std::lower_bound( items.begin(), items.end(), sp, itemLess );
 
@@ -15,6 +15,8 @@
 
 namespace cbrc{
 
+class MultiSequence;
+
 template< typename Container, typename Predicate >
 void erase_if( Container& c, Predicate p ){
   c.erase( std::remove_if( c.begin(), c.end(), p ), c.end() );
@@ -52,9 +54,33 @@ struct SegmentPairPot{
   // to avoid death by dynamic programming when self-aligning a large sequence
   void markTandemRepeats( const SegmentPair& sp, size_t maxDistance );
 
+  // group the items into colinear chains, with gaps <= maxGap
+  // between consecutive items, and all items in the same sequence of
+  // seqs1.  Each item belongs to exactly one chain: the best chains
+  // are found first, and the others can't reuse their items.  This
+  // must be called after sort()
+  void chain( size_t maxGap, const MultiSequence& seqs1 );
+
+  // the sum of scores of the items in sp's chain (including marked
+  // items, with their original scores).  sp must be one of the items
+  long chainScore( const SegmentPair& sp ) const
+  { return chainScores[&sp - &items[0]]; }
+
+  // mark the items in sp's chain that lie inside the ranges
+  // [beg1, end1) and [beg2, end2).  sp must be one of the items
+  void markChainMates( const SegmentPair& sp, size_t beg1, size_t end1,
+		       size_t beg2, size_t end2 );
+
+  // get the items in sp's chain (including sp and marked items),
+  // sorted by query start.  sp must be one of the items
+  void getChain( const SegmentPair& sp,
+		 std::vector<SegmentPair>& chainItems ) const;
+
   // data:
   std::vector<SegmentPair> items;
   std::vector<iterator> iters;
+  std::vector<size_t> chainLinks;  // circular list of each chain's items
+  std::vector<long> chainScores;
 
   // sort criterion for sorting by position
   static bool itemLess( const SegmentPair& x, const SegmentPair& y ){
@@ -41,4 +41,38 @@ bool SubsetMinimizerFinder::isMinimizer(const CyclicSubsetSeed &seed,
   }
 }
 
+void SubsetMinimizerFinder::findMinimizers(const CyclicSubsetSeed &seed,
+					   const uchar *limit,
+					   const uchar *end,
+					   size_t window,
+					   std::vector<const uchar *> &out) {
+  const uchar *subsetMap = seed.firstMap();
+
+  // The current minimum is always one that wasn't output yet
+  while (minima[0] < limit) {
+    const uchar *currentMinimum = minima[0];
+    out.push_back(currentMinimum);
+    do {
+      const uchar *newPos = minima.back() + 1;
+      if (newPos == end) {
+	minima.assign(1, end);
+	return;
+      }
+      if (subsetMap[*newPos] == CyclicSubsetSeed::DELIMITER) {
+	init(seed, newPos + 1, end);
+	break;
+      }
+      size_t diff = newPos - currentMinimum;
+      size_t stop = (diff >= window);
+      size_t i = minima.size();
+      while (i > stop && seed.isLess(newPos, minima[i - 1], subsetMap)) {
+	--i;
+      }
+      minima.resize(i);
+      if (stop) minima.erase(minima.begin());
+      minima.push_back(newPos);
+    } while (minima[0] == currentMinimum);
+  }
+}
+
 }
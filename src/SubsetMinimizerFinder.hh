@@ -18,6 +18,12 @@
 // order: specifically, each value of pos must be >= beg and all
 // previous values of pos.
 
+// Alternatively, after "init", call findMinimizers to get all the
+// minimizers before some limit, then call it again with a later
+// limit to get the next ones, and so on.  This is faster than
+// calling isMinimizer for every position, because it visits each
+// minimizer once, instead of each position.
+
 #ifndef SUBSET_MINIMIZER_FINDER_HH
 #define SUBSET_MINIMIZER_FINDER_HH
 
@@ -41,6 +47,14 @@ public:
 		    const uchar *end,
 		    size_t window);
 
+  // Append to "out" the minimizers that start before "limit", and were
+  // not found by previous calls
+  void findMinimizers(const CyclicSubsetSeed &seed,
+		      const uchar *limit,
+		      const uchar *end,
+		      size_t window,
+		      std::vector<const uchar *> &out);
+
 private:
   std::vector<const uchar *> minima;
 };
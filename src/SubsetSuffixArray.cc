@@ -14,34 +14,131 @@ static void err(const std::string &s) {
   throw std::runtime_error(s);
 }
 
-void SubsetSuffixArray::setWordPositions(const DnaWordsFinder &finder,
-					 size_t *cumulativeCounts,
-					 const uchar *seqBeg,
-					 const uchar *seqEnd) {
-  size_t numOfSeeds = seeds.size();
-  size_t wordLength = finder.wordLength;
-  size_t sumOfCounts = 0;
-  for (size_t i = 0; i < numOfSeeds; ++i) {
-    std::swap(cumulativeCounts[i], sumOfCounts);
-  }
-  resizePositions(sumOfCounts, seqEnd - seqBeg);
+static void setSomeWordPositions(SubsetSuffixArray *sa,
+				 const DnaWordsFinder *finder,
+				 const size_t *sliceBegs, const size_t *sliceEnds,
+				 const uchar *text, const uchar *seqBeg,
+				 const uchar *seqEnd,
+				 std::vector<size_t> *edgeItems) {
+  size_t wordLength = finder->wordLength;
+  size_t counts[dnaWordsFinderNull + 1];
+  std::copy(sliceBegs, sliceBegs + dnaWordsFinderNull + 1, counts);
 
   unsigned hash = 0;
-  const uchar *seqPos = finder.init(seqBeg, seqEnd, &hash);
+  const uchar *seqPos = finder->init(seqBeg, seqEnd, &hash);
   while (seqPos < seqEnd) {
-    unsigned c = finder.baseToCode[*seqPos];
+    unsigned c = finder->baseToCode[*seqPos];
     ++seqPos;
     if (c != dnaWordsFinderNull) {
-      unsigned w = finder.next(&hash, c);
+      unsigned w = finder->next(&hash, c);
       if (w != dnaWordsFinderNull) {
-	setPosition(cumulativeCounts[w]++, seqPos - seqBeg - wordLength);
+	size_t i = counts[w]++;
+	size_t pos = seqPos - text - wordLength;
+	if (sa->isPositionNearEdge(sliceBegs[w], sliceEnds[w], i)) {
+	  edgeItems->push_back(i);
+	  edgeItems->push_back(pos);
+	} else {
+	  sa->setPosition(i, pos);
+	}
       }
     } else {
-      seqPos = finder.init(seqPos, seqEnd, &hash);
+      seqPos = finder->init(seqPos, seqEnd, &hash);
+    }
+  }
+}
+
+void SubsetSuffixArray::setWordPositions(const DnaWordsFinder &finder,
+					 const size_t *cumulativeCounts,
+					 const size_t *chunkWordCounts,
+					 const uchar *text,
+					 const uchar *const *chunkBegs,
+					 size_t numOfChunks) {
+  const size_t n = dnaWordsFinderNull + 1;
+  size_t numOfSeeds = seeds.size();
+  resizePositions(cumulativeCounts[numOfSeeds - 1],
+		  chunkBegs[numOfChunks] - text);
+
+  // Get the start of each chunk's slice of the suffix array, for
+  // each word.  The slices for one chunk end where the next chunk's
+  // slices begin, so we append the word ends as a final "chunk".
+  std::vector<size_t> sliceBegs((numOfChunks + 1) * n);
+  for (size_t w = 0; w < numOfSeeds; ++w) {
+    size_t sum = w ? cumulativeCounts[w - 1] : 0;
+    for (size_t i = 0; i < numOfChunks; ++i) {
+      sliceBegs[i * n + w] = sum;
+      sum += chunkWordCounts[i * n + w];
+    }
+    sliceBegs[numOfChunks * n + w] = sum;
+  }
+
+  std::vector< std::vector<size_t> > edgeItems(numOfChunks);
+  const size_t *b = &sliceBegs[0];
+  std::vector<std::thread> threads(numOfChunks - 1);
+  for (size_t i = 1; i < numOfChunks; ++i) {
+    threads[i - 1] = std::thread(setSomeWordPositions, this, &finder,
+				 b + i * n, b + (i + 1) * n, text,
+				 chunkBegs[i], chunkBegs[i + 1], &edgeItems[i]);
+  }
+  setSomeWordPositions(this, &finder, b, b + n, text,
+		       chunkBegs[0], chunkBegs[1], &edgeItems[0]);
+  for (size_t i = 1; i < numOfChunks; ++i) {
+    threads[i - 1].join();
+  }
+
+  for (size_t i = 0; i < numOfChunks; ++i) {
+    const std::vector<size_t> &v = edgeItems[i];
+    for (size_t j = 0; j < v.size(); j += 2) setPosition(v[j], v[j + 1]);
+  }
+}
+
+static void makeSomePrefixCache(uchar *cache, size_t cacheWidth,
+				ConstPackedArray sa, size_t beg, size_t end,
+				const uchar *text, size_t textLength,
+				size_t depth, const uchar *const *subsetMaps) {
+  for (size_t i = beg; i < end; ++i) {
+    size_t t = getItem(sa, i) + depth;
+    uchar *c = cache + i * cacheWidth;
+    for (size_t j = 0; j < cacheWidth; ++j, ++t) {
+      c[j] = (t < textLength) ? subsetMaps[j][text[t]]
+	:                       uchar(CyclicSubsetSeed::DELIMITER);
     }
   }
 }
 
+void SubsetSuffixArray::makePrefixCache(const uchar *text, size_t textLength,
+					size_t cacheWidth,
+					size_t numOfThreads) {
+  size_t indexedPositions = getItem(bckArray, bucketEnds.back());
+  prefixCacheWidth = cacheWidth;
+  prefixCache.v.resize(indexedPositions * cacheWidth);
+  if (prefixCache.v.empty()) return;
+  uchar *cache = &prefixCache.v[0];
+
+  for (size_t s = 0; s < seeds.size(); ++s) {
+    const CyclicSubsetSeed &seed = seeds[s];
+    size_t depth = maxBucketPrefix(s);
+    std::vector<const uchar *> maps(cacheWidth);
+    for (size_t j = 0; j < cacheWidth; ++j) {
+      maps[j] = seed.originalSubsetMap(seed.subsetMap(depth + j));
+    }
+    size_t beg = getItem(bckArray, bucketEnds[s]);
+    size_t end = getItem(bckArray, bucketEnds[s + 1]);
+    size_t numOfChunks = std::min(numOfThreads, end - beg);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numOfChunks; ++i) {
+      size_t b = beg + (end - beg) * i / numOfChunks;
+      size_t e = beg + (end - beg) * (i + 1) / numOfChunks;
+      threads.push_back(std::thread(makeSomePrefixCache, cache, cacheWidth,
+				    sufArray, b, e, text, textLength, depth,
+				    &maps[0]));
+    }
+    size_t e = numOfChunks ? beg + (end - beg) / numOfChunks : end;
+    makeSomePrefixCache(cache, cacheWidth, sufArray, beg, e,
+			text, textLength, depth, &maps[0]);
+    for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+  }
+}
+
 void SubsetSuffixArray::fromFiles( const std::string& baseName,
 				   int bitsPerInt,
 				   bool isMaskLowercase,
@@ -50,6 +147,7 @@ void SubsetSuffixArray::fromFiles( const std::string& baseName,
   size_t textLength = 0;  // 0 never occurs in a valid file
   size_t unindexedPositions = 0;  // 0 never occurs in a valid file
   unsigned version = 0;
+  prefixCacheWidth = 0;
   std::vector<unsigned> bucketDepths;
   seeds.clear();
 
@@ -64,6 +162,7 @@ void SubsetSuffixArray::fromFiles( const std::string& baseName,
     if( word == "version" ) iss >> version;
     if( word == "totallength" ) iss >> textLength;
     if( word == "specialcharacters" ) iss >> unindexedPositions;
+    if( word == "prefixcache" ) iss >> prefixCacheWidth;
     if( word == "prefixlength" ){
       if (!seeds.empty() && !seeds.back().span()) {
 	err("can't read file: " + fileName);
@@ -116,6 +215,9 @@ void SubsetSuffixArray::fromFiles( const std::string& baseName,
   sufArray.items = (const size_t *)suffixArray.m.begin();
   buckets.m.open(baseName + ".bck", bckSize);
   bckArray.items = (const size_t *)buckets.m.begin();
+  if (prefixCacheWidth && indexedPositions) {
+    prefixCache.m.open(baseName + ".pfx", indexedPositions * prefixCacheWidth);
+  }
 
   try{
     childTable.m.open(baseName + ".chi", chiSize);
@@ -132,7 +234,8 @@ void SubsetSuffixArray::fromFiles( const std::string& baseName,
 }
 
 void SubsetSuffixArray::toFiles( const std::string& baseName,
-				 bool isAppendPrj, size_t textLength ) const{
+				 bool isAppendPrj, size_t textLength,
+				 size_t numOfThreads ) const{
   size_t indexedPositions = bckArray[bucketEnds.back()];
   assert(textLength > indexedPositions);
 
@@ -142,6 +245,7 @@ void SubsetSuffixArray::toFiles( const std::string& baseName,
 
   f << "totallength=" << textLength << '\n';
   f << "specialcharacters=" << textLength - indexedPositions << '\n';
+  if (prefixCacheWidth) f << "prefixcache=" << prefixCacheWidth << '\n';
 
   for (size_t s = 0; s < seeds.size(); ++s) {
     f << "prefixlength=" << maxBucketPrefix(s) << '\n';
@@ -155,21 +259,30 @@ void SubsetSuffixArray::toFiles( const std::string& baseName,
   f.close();
   if (!f) err("can't write file: " + fileName);
 
-  memoryToBinaryFile( suffixArray.begin(), suffixArray.end(),
-		      baseName + ".suf" );
-  memoryToBinaryFile( buckets.begin(), buckets.end(), baseName + ".bck" );
+  std::vector<MemoryFile> files;
+  if (!suffixArray.v.empty()) {
+    addMemoryFile( files, suffixArray.begin(), suffixArray.end(),
+		   baseName + ".suf" );
+  }
+  addMemoryFile( files, buckets.begin(), buckets.end(), baseName + ".bck" );
+
+  fileName = baseName + ".pfx";
+  std::remove( fileName.c_str() );
+  addMemoryFile( files, prefixCache.begin(), prefixCache.end(), fileName );
 
   fileName = baseName + ".chi";
   std::remove( fileName.c_str() );
-  memoryToBinaryFile( childTable.begin(), childTable.end(), fileName );
+  addMemoryFile( files, childTable.begin(), childTable.end(), fileName );
 
   fileName = baseName + ".chi2";
   std::remove( fileName.c_str() );
-  memoryToBinaryFile( kiddyTable.begin(), kiddyTable.end(), fileName );
+  addMemoryFile( files, kiddyTable.begin(), kiddyTable.end(), fileName );
 
   fileName = baseName + ".chi1";
   std::remove( fileName.c_str() );
-  memoryToBinaryFile( chibiTable.begin(), chibiTable.end(), fileName );
+  addMemoryFile( files, chibiTable.begin(), chibiTable.end(), fileName );
+
+  memoryToBinaryFiles( files, numOfThreads );
 }
 
 static size_t bucketPos(const uchar *text, const CyclicSubsetSeed &seed,
@@ -179,36 +292,60 @@ static size_t bucketPos(const uchar *text, const CyclicSubsetSeed &seed,
   return bucketValue(seed, seed.firstMap(), steps, text + position, depth) + 1;
 }
 
-static void makeSomeBuckets(const uchar *text, const CyclicSubsetSeed &seed,
+static void makeSomeBuckets(const uchar *text, const CyclicSubsetSeed *seed,
 			    const size_t *steps, int depth,
-			    PackedArray buckets,
-			    size_t buckBeg, size_t buckIdx,
-			    ConstPackedArray sa, size_t saBeg, size_t saEnd) {
+			    PackedArray buckets, size_t buckBeg,
+			    size_t buckIdx, size_t buckEnd,
+			    ConstPackedArray sa, size_t saBeg, size_t saEnd,
+			    std::vector<size_t> *edgeItems) {
+  size_t idxBeg = buckIdx;
   for (size_t i = saBeg; i < saEnd; ++i) {
-    size_t b = buckBeg + bucketPos(text, seed, steps, depth, sa, i);
+    size_t b = buckBeg + bucketPos(text, *seed, steps, depth, sa, i);
     for (; buckIdx < b; ++buckIdx) {
-      buckets.set(buckIdx, i);
+      if (isNearRangeEdge(buckets.bitsPerItem, idxBeg, buckEnd, buckIdx)) {
+	edgeItems->push_back(buckIdx);
+	edgeItems->push_back(i);
+      } else {
+	buckets.set(buckIdx, i);
+      }
     }
   }
 }
 
-static void runThreads(const uchar *text, const CyclicSubsetSeed *seedPtr,
+// Divide the suffix array range into one chunk per thread.  Each
+// thread sets the buckets that end in its chunk, apart from buckets
+// whose bits may share memory words with another thread's buckets.
+static void runThreads(const uchar *text, const CyclicSubsetSeed *seed,
 		       const size_t *steps, int depth, PackedArray buckets,
 		       size_t buckBeg, size_t buckIdx, ConstPackedArray sa,
 		       size_t saBeg, size_t saEnd, size_t numOfThreads) {
-  const CyclicSubsetSeed &seed = *seedPtr;
-  if (numOfThreads > 1) {
-    size_t len = (saEnd - saBeg + numOfThreads - 1) / numOfThreads;
-    size_t mid = saBeg + len;
-    size_t b = buckBeg + bucketPos(text, seed, steps, depth, sa, mid - 1);
-    std::thread t(runThreads, text, seedPtr, steps, depth, buckets, buckBeg,
-		  b, sa, mid, saEnd, numOfThreads - 1);
-    makeSomeBuckets(text, seed, steps, depth, buckets, buckBeg,
-		    buckIdx, sa, saBeg, mid);
-    t.join();
-  } else {
-    makeSomeBuckets(text, seed, steps, depth, buckets, buckBeg,
-		    buckIdx, sa, saBeg, saEnd);
+  size_t len = (saEnd - saBeg + numOfThreads - 1) / numOfThreads;
+  numOfThreads = (saEnd - saBeg + len - 1) / len;
+  std::vector<size_t> buckIdxs(numOfThreads + 1, buckIdx);
+  for (size_t i = 1; i <= numOfThreads; ++i) {
+    size_t saPos = std::min(saBeg + i * len, saEnd) - 1;
+    buckIdxs[i] = buckBeg + bucketPos(text, *seed, steps, depth, sa, saPos);
+  }
+
+  std::vector< std::vector<size_t> > edgeItems(numOfThreads);
+  std::vector<std::thread> threads(numOfThreads - 1);
+  for (size_t i = 1; i < numOfThreads; ++i) {
+    size_t b = saBeg + i * len;
+    size_t e = std::min(b + len, saEnd);
+    threads[i - 1] = std::thread(makeSomeBuckets, text, seed, steps, depth,
+				 buckets, buckBeg, buckIdxs[i], buckIdxs[i + 1],
+				 sa, b, e, &edgeItems[i]);
+  }
+  makeSomeBuckets(text, seed, steps, depth, buckets, buckBeg, buckIdxs[0],
+		  buckIdxs[1], sa, saBeg, std::min(saBeg + len, saEnd),
+		  &edgeItems[0]);
+  for (size_t i = 1; i < numOfThreads; ++i) {
+    threads[i - 1].join();
+  }
+
+  for (size_t i = 0; i < numOfThreads; ++i) {
+    const std::vector<size_t> &v = edgeItems[i];
+    for (size_t j = 0; j < v.size(); j += 2) buckets.set(v[j], v[j + 1]);
   }
 }
 
@@ -104,21 +104,57 @@ inline size_t bucketValue(const CyclicSubsetSeed &seed, const uchar *subsetMap,
   return val;
 }
 
+// The sorted suffix positions, plus an optional cache of the
+// letter-subsets at depths [cacheDepth, cacheDepth + cacheWidth) of
+// each suffix, so that binary search can often avoid reading the text
+struct SortedSuffixes {
+  ConstPackedArray positions;
+  const uchar *cache;
+  size_t cacheWidth;
+  size_t cacheDepth;
+
+  // Get the subset of the letter at "depth" in the i-th suffix.
+  // "pos" is the i-th suffix's start, or -1 if we haven't read it yet.
+  uchar subset(size_t i, size_t depth, size_t &pos,
+	       BigSeq text, const uchar *textSubsetMap) const {
+    size_t j = depth - cacheDepth;
+    if (j < cacheWidth) return cache[i * cacheWidth + j];
+    if (pos + 1 == 0) pos = getItem(positions, i);
+    return textSubsetMap[text[pos + depth]];
+  }
+
+  uchar subset(size_t i, size_t depth,
+	       BigSeq text, const uchar *textSubsetMap) const {
+    size_t pos = -1;
+    return subset(i, depth, pos, text, textSubsetMap);
+  }
+};
+
 class SubsetSuffixArray {
 public:
   struct Range {size_t beg; size_t end; size_t depth;};
 
+  SubsetSuffixArray() : prefixCacheWidth(0) {}
+
   std::vector<CyclicSubsetSeed> &getSeeds() { return seeds; }
   const std::vector<CyclicSubsetSeed> &getSeeds() const { return seeds; }
 
   void resizePositions(size_t numOfPositions, size_t seqLength) {
-    sufArray.bitsPerItem = numOfBitsNeededFor(seqLength - 1);
-    bckArray.bitsPerItem = numOfBitsNeededFor(numOfPositions);
-    chiArray.bitsPerItem = numOfBitsNeededFor(numOfPositions - 1);
+    setBitsPerItem(numOfPositions, seqLength);
     suffixArray.v.resize(numOfBytes(sufArray.bitsPerItem, numOfPositions));
     sufArray.items = (const size_t *)suffixArray.begin();
   }
 
+  // Use sorted positions that were already written to a .suf file:
+  // toFiles won't write them again
+  void mapPositions(const std::string &fileName,
+		    size_t numOfPositions, size_t seqLength) {
+    setBitsPerItem(numOfPositions, seqLength);
+    suffixArray.m.open(fileName,
+		       numOfBytes(sufArray.bitsPerItem, numOfPositions));
+    sufArray.items = (const size_t *)suffixArray.begin();
+  }
+
   // Get the i-th item in the suffix array
   size_t getPosition(size_t i) const {
     return getItem(sufArray, i);
@@ -129,11 +165,22 @@ public:
     setBits(sufArray.bitsPerItem, (size_t *)&suffixArray.v[0], i, x);
   }
 
-  // Store positions in [seqBeg, seqEnd) where certain "words" start.
-  // The cumulative word counts must be provided.  (cumulativeCounts
-  // is internally modified and restored to its original values).
-  void setWordPositions(const DnaWordsFinder &finder, size_t *cumulativeCounts,
-			const uchar *seqBeg, const uchar *seqEnd);
+  // Is the i-th item too near the edge of [beg, end) to be set by a
+  // thread that sets that range, while other threads set other items?
+  bool isPositionNearEdge(size_t beg, size_t end, size_t i) const {
+    return isNearRangeEdge(sufArray.bitsPerItem, beg, end, i);
+  }
+
+  // Store positions in the text where certain "words" start.  The
+  // text is divided into chunks: chunk i is [chunkBegs[i],
+  // chunkBegs[i+1]), and chunks must not split any word.  Each chunk
+  // is done by its own thread.  The cumulative word counts must be
+  // provided, and also the count of each word in each chunk
+  // (dnaWordsFinderNull+1 counts per chunk).
+  void setWordPositions(const DnaWordsFinder &finder,
+			const size_t *cumulativeCounts,
+			const size_t *chunkWordCounts, const uchar *text,
+			const uchar *const *chunkBegs, size_t numOfChunks);
 
   // Sort the suffix array (but don't make the buckets).
   void sortIndex(const uchar *text,
@@ -149,21 +196,32 @@ public:
 		   size_t minPositionsPerBucket, unsigned bucketDepth,
 		   size_t numOfThreads);
 
+  // Store the letter-subsets at depths [d, d + cacheWidth) of each
+  // suffix, where d is the bucket depth.  This costs cacheWidth bytes
+  // per position, and makes match() read the text less often.
+  void makePrefixCache(const uchar *text, size_t textLength,
+		       size_t cacheWidth, size_t numOfThreads);
+
   void fromFiles(const std::string &baseName, int bitsPerInt,
 		 bool isMaskLowercase, const uchar letterCode[],
 		 const std::string &mainSequenceAlphabet);
 
+  // Write up to numOfThreads files at once
   void toFiles( const std::string& baseName,
-		bool isAppendPrj, size_t textLength ) const;
+		bool isAppendPrj, size_t textLength,
+		size_t numOfThreads ) const;
 
   // Find the smallest match to the text, starting at the given
   // position in the query, such that there are at most maxHits
   // matches, and the match-depth is at least minDepth, or the
   // match-depth is maxDepth.  Return the range of matching indices
-  // via beg and end.
+  // via beg and end.  But if the match to the deepest bucket (or
+  // maxDepth, if that's shallower) has more than maxBucketHits
+  // matches, return no matches, without searching deeper.
   void match(size_t &beg, size_t &end,
 	     const uchar *queryPtr, BigSeq text, unsigned seedNum,
-	     size_t maxHits, size_t minDepth, size_t maxDepth) const;
+	     size_t maxHits, size_t minDepth, size_t maxDepth,
+	     size_t maxBucketHits) const;
 
   // Count matches of all sizes (up to maxDepth), starting at the
   // given position in the query.
@@ -171,6 +229,11 @@ public:
 		     const uchar *queryPtr, BigSeq text,
 		     unsigned seedNum, size_t maxDepth ) const;
 
+  // Return the index of the deepest bucket matching the query at the
+  // given position.  Buckets are in suffix-array order, so positions
+  // with nearby bucket indices get matched to nearby parts of the index.
+  size_t bucketIndex(const uchar *queryPtr, unsigned seedNum) const;
+
 private:
   std::vector<CyclicSubsetSeed> seeds;
   std::vector<size_t> bucketEnds;
@@ -185,6 +248,9 @@ private:
   VectorOrMmap<unsigned short> kiddyTable;  // smaller child table
   VectorOrMmap<unsigned char> chibiTable;  // even smaller child table
 
+  VectorOrMmap<uchar> prefixCache;
+  size_t prefixCacheWidth;
+
   ConstPackedArray sufArray;
   ConstPackedArray bckArray;
   ConstPackedArray chiArray;
@@ -193,7 +259,20 @@ private:
 
   // This does the same thing as equalRange, but uses a child table:
   void childRange(size_t &beg, size_t &end, ChildDirection &childDirection,
-		  BigPtr textBase, const uchar *subsetMap, uchar subset) const;
+		  const SortedSuffixes &sa, BigSeq text, size_t depth,
+		  const uchar *subsetMap, uchar subset) const;
+
+  SortedSuffixes sortedSuffixes(unsigned seedNum) const {
+    SortedSuffixes s = {sufArray, prefixCache.begin(), prefixCacheWidth,
+			maxBucketPrefix(seedNum)};
+    return s;
+  }
+
+  void setBitsPerItem(size_t numOfPositions, size_t seqLength) {
+    sufArray.bitsPerItem = numOfBitsNeededFor(seqLength - 1);
+    bckArray.bitsPerItem = numOfBitsNeededFor(numOfPositions);
+    chiArray.bitsPerItem = numOfBitsNeededFor(numOfPositions - 1);
+  }
 
   // Return the maximum prefix size covered by the buckets.
   size_t maxBucketPrefix(unsigned seedNum) const
@@ -5,12 +5,12 @@
 
 using namespace cbrc;
 
-static size_t lowerBound(ConstPackedArray sufArray, size_t beg, size_t end,
-			 const BigPtr &textBase, const uchar *subsetMap,
+static size_t lowerBound(const SortedSuffixes &sa, size_t beg, size_t end,
+			 BigSeq text, size_t depth, const uchar *subsetMap,
 			 uchar subset) {
   while (beg < end) {
     size_t mid = beg + (end - beg) / 2;
-    if (subsetMap[textBase[getItem(sufArray, mid)]] < subset) {
+    if (sa.subset(mid, depth, text, subsetMap) < subset) {
       beg = mid + 1;
     } else {
       end = mid;
@@ -19,12 +19,12 @@ static size_t lowerBound(ConstPackedArray sufArray, size_t beg, size_t end,
   return beg;
 }
 
-static size_t upperBound(ConstPackedArray sufArray, size_t beg, size_t end,
-			 const BigPtr &textBase, const uchar *subsetMap,
+static size_t upperBound(const SortedSuffixes &sa, size_t beg, size_t end,
+			 BigSeq text, size_t depth, const uchar *subsetMap,
 			 uchar subset) {
   while (beg < end) {
     size_t mid = beg + (end - beg) / 2;
-    if (subsetMap[textBase[getItem(sufArray, mid)]] <= subset) {
+    if (sa.subset(mid, depth, text, subsetMap) <= subset) {
       beg = mid + 1;
     } else {
       end = mid;
@@ -35,71 +35,71 @@ static size_t upperBound(ConstPackedArray sufArray, size_t beg, size_t end,
 
 // Find the suffix array range of one letter, whose subset is
 // "subset", within the suffix array range [beg, end)
-static void equalRange(ConstPackedArray sufArray, size_t &beg, size_t &end,
-		       const BigPtr &textBase, const uchar *subsetMap,
+static void equalRange(const SortedSuffixes &sa, size_t &beg, size_t &end,
+		       BigSeq text, size_t depth, const uchar *subsetMap,
 		       uchar subset) {
   while (beg < end) {
     size_t mid = beg + (end - beg) / 2;
-    uchar s = subsetMap[textBase[getItem(sufArray, mid)]];
+    uchar s = sa.subset(mid, depth, text, subsetMap);
     if (s < subset) {
       beg = mid + 1;
     } else if (s > subset) {
       end = mid;
     } else {
-      beg = lowerBound(sufArray, beg, mid, textBase, subsetMap, subset);
-      end = upperBound(sufArray, mid + 1, end, textBase, subsetMap, subset);
+      beg = lowerBound(sa, beg, mid, text, depth, subsetMap, subset);
+      end = upperBound(sa, mid + 1, end, text, depth, subsetMap, subset);
       return;
     }
   }
 }
 
 // Same as the 1st equalRange, but uses more info and may be faster
-static void equalRange(ConstPackedArray sufArray, size_t &beg, size_t &end,
-		       const BigPtr &textBase, const uchar *subsetMap,
+static void equalRange(const SortedSuffixes &sa, size_t &beg, size_t &end,
+		       BigSeq text, size_t depth, const uchar *subsetMap,
 		       uchar subset, uchar begSubset, uchar endSubset,
 		       size_t begOffset, size_t endOffset) {
   size_t b = beg + begOffset;
   size_t e = end - endOffset;
   if (subset == begSubset) {
-    end = upperBound(sufArray, b, e, textBase, subsetMap, subset);
+    end = upperBound(sa, b, e, text, depth, subsetMap, subset);
   } else if (subset == endSubset) {
-    beg = lowerBound(sufArray, b, e, textBase, subsetMap, subset);
+    beg = lowerBound(sa, b, e, text, depth, subsetMap, subset);
   } else {
     beg = b;
     end = e;
-    equalRange(sufArray, beg, end, textBase, subsetMap, subset);
+    equalRange(sa, beg, end, text, depth, subsetMap, subset);
   }
 }
 
 // Same as the 1st equalRange, but tries to be faster by checking endpoints
-static void fastEqualRange(ConstPackedArray sufArray, size_t &beg, size_t &end,
-			   const BigPtr &textBase, const uchar *subsetMap,
+static void fastEqualRange(const SortedSuffixes &sa, size_t &beg, size_t &end,
+			   BigSeq text, size_t depth, const uchar *subsetMap,
 			   uchar subset) {
-  uchar b = subsetMap[textBase[getItem(sufArray, beg)]];
+  uchar b = sa.subset(beg, depth, text, subsetMap);
   if (subset < b) { end = beg; return; }
-  uchar e = subsetMap[textBase[getItem(sufArray, end - 1)]];
+  uchar e = sa.subset(end - 1, depth, text, subsetMap);
   if (subset > e) { beg = end; return; }
   if (b == e) return;
-  equalRange(sufArray, beg, end, textBase, subsetMap, subset, b, e, 1, 1);
+  equalRange(sa, beg, end, text, depth, subsetMap, subset, b, e, 1, 1);
 }
 
-static size_t lowerBound2(ConstPackedArray sufArray, size_t beg, size_t end,
+static size_t lowerBound2(const SortedSuffixes &sa, size_t beg, size_t end,
 			  BigSeq text, size_t depth, const uchar *subsetMap,
 			  const uchar *queryBeg, const uchar *queryEnd,
 			  const CyclicSubsetSeed &seed) {
   while (beg < end) {
     size_t mid = beg + (end - beg) / 2;
-    size_t offset = getItem(sufArray, mid);
-    size_t t = depth + offset;
+    size_t pos = -1;
+    size_t t = depth;
     const uchar *q = queryBeg;
     const uchar *s = subsetMap;
     for (;;) {  // loop over consecutive letters
       const uchar *textSubsetMap = seed.originalSubsetMap(s);
-      if (textSubsetMap[text[t]] < s[*q]) {
+      if (sa.subset(mid, t, pos, text, textSubsetMap) < s[*q]) {
 	beg = mid + 1;
 	// the next 3 lines are unnecessary, but make it faster:
 	queryBeg = q;
-	depth = t - offset;
+	depth = t;
 	subsetMap = s;
 	break;
       }
@@ -115,23 +115,23 @@ static size_t lowerBound2(ConstPackedArray sufArray, size_t beg, size_t end,
   return beg;
 }
 
-static size_t upperBound2(ConstPackedArray sufArray, size_t beg, size_t end,
+static size_t upperBound2(const SortedSuffixes &sa, size_t beg, size_t end,
 			  BigSeq text, size_t depth, const uchar *subsetMap,
 			  const uchar *queryBeg, const uchar *queryEnd,
 			  const CyclicSubsetSeed &seed) {
   while (beg < end) {
     size_t mid = beg + (end - beg) / 2;
-    size_t offset = getItem(sufArray, mid);
-    size_t t = depth + offset;
+    size_t pos = -1;
+    size_t t = depth;
     const uchar *q = queryBeg;
     const uchar *s = subsetMap;
     for (;;) {  // loop over consecutive letters
       const uchar *textSubsetMap = seed.originalSubsetMap(s);
-      if (textSubsetMap[text[t]] > s[*q]) {
+      if (sa.subset(mid, t, pos, text, textSubsetMap) > s[*q]) {
 	end = mid;
 	// the next 3 lines are unnecessary, but make it faster:
 	queryBeg = q;
-	depth = t - offset;
+	depth = t;
 	subsetMap = s;
         break;
       }
@@ -149,7 +149,7 @@ static size_t upperBound2(ConstPackedArray sufArray, size_t beg, size_t end,
 
 // Find the suffix array range of string [queryBeg, queryEnd) within
 // the suffix array range [beg, end)
-static void equalRange2(ConstPackedArray sufArray, size_t &beg, size_t &end,
+static void equalRange2(const SortedSuffixes &sa, size_t &beg, size_t &end,
 			BigSeq text, size_t depth, const uchar *subsetMap,
 			const uchar *queryBeg, const uchar *queryEnd,
 			const CyclicSubsetSeed &seed) {
@@ -162,30 +162,30 @@ static void equalRange2(ConstPackedArray sufArray, size_t &beg, size_t &end,
 
   while (beg < end) {
     size_t mid = beg + (end - beg) / 2;
-    size_t offset = getItem(sufArray, mid);
+    size_t pos = -1;
     const uchar *q;
     size_t t;
     const uchar *s;
     if (qBeg < qEnd) {
       q = qBeg;
-      t = tBeg + offset;
+      t = tBeg;
       s = sBeg;
     } else {
       q = qEnd;
-      t = tEnd + offset;
+      t = tEnd;
       s = sEnd;
     }
     uchar x, y;
     for (;;) {  // loop over consecutive letters
       const uchar *textSubsetMap = seed.originalSubsetMap(s);
-      x = textSubsetMap[text[t]];  // this text letter's subset
+      x = sa.subset(mid, t, pos, text, textSubsetMap);  // text letter's subset
       y = s[*q];  // this query letter's subset
       if (x != y) break;
       ++q;  // next query letter
       if (q == queryEnd) {  // we found a full match to [queryBeg, queryEnd)
-	beg = lowerBound2(sufArray, beg, mid, text, tBeg, sBeg,
+	beg = lowerBound2(sa, beg, mid, text, tBeg, sBeg,
 			  qBeg, queryEnd, seed);
-	end = upperBound2(sufArray, mid + 1, end, text, tEnd, sEnd,
+	end = upperBound2(sa, mid + 1, end, text, tEnd, sEnd,
 			  qEnd, queryEnd, seed);
 	return;
       }
@@ -196,13 +196,13 @@ static void equalRange2(ConstPackedArray sufArray, size_t &beg, size_t &end,
       beg = mid + 1;
       // the next 3 lines are unnecessary, but make it faster:
       qBeg = q;
-      tBeg = t - offset;
+      tBeg = t;
       sBeg = s;
     } else {
       end = mid;
       // the next 3 lines are unnecessary, but make it faster:
       qEnd = q;
-      tEnd = t - offset;
+      tEnd = t;
       sEnd = s;
     }
   }
@@ -215,7 +215,7 @@ static void equalRange2(ConstPackedArray sufArray, size_t &beg, size_t &end,
 // returned.  Actually, this routine may find *part* of the SA range
 // of [queryBeg, queryBeg+d), which is guaranteed to include the whole
 // range for the smallest d whose range is no longer than maxHits.
-static size_t equalRange3(ConstPackedArray sufArray, size_t &beg, size_t &end,
+static size_t equalRange3(const SortedSuffixes &sa, size_t &beg, size_t &end,
 			  const uchar *&subsetMap, BigSeq text, size_t depth,
 			  const uchar *queryBeg, const CyclicSubsetSeed &seed,
 			  size_t maxHits) {
@@ -239,13 +239,12 @@ static size_t equalRange3(ConstPackedArray sufArray, size_t &beg, size_t &end,
 
   while (end - beg > maxHits * 2) {
     size_t mid = beg + (end - beg) / 2;
-    size_t offset = getItem(sufArray, mid);
-    tMid += offset;
+    size_t pos = -1;
     int iterations = 1023;  // xxx ???
     uchar tChar, qChar;
     for (;;) {  // loop over consecutive letters
       const uchar *textSubsetMap = seed.originalSubsetMap(sMid);
-      tChar = textSubsetMap[text[tMid]];  // this text letter's subset
+      tChar = sa.subset(mid, tMid, pos, text, textSubsetMap);
       qChar = sMid[*qMid];  // this query letter's subset
       if (tChar != qChar || qChar == CyclicSubsetSeed::DELIMITER) break;
       if (--iterations == 0) {  // avoid huge self-comparisons
@@ -256,7 +255,6 @@ static size_t equalRange3(ConstPackedArray sufArray, size_t &beg, size_t &end,
       ++tMid;  // next text letter
       sMid = seed.nextMap(sMid);  // next mapping from letters to subsets
     }
-    tMid -= offset;
     if (tChar <= qChar) {
       beg = mid + 1;
       qBegOld = qBeg;
@@ -294,22 +292,22 @@ static size_t equalRange3(ConstPackedArray sufArray, size_t &beg, size_t &end,
     qMid = std::max(qBeg, qEndOld) + 1;
     subsetMap = seed.nextMap(qBeg > qEndOld ? sBeg : sEndOld);
     if (qMid > qEnd) {
-      equalRange2(sufArray, beg, end, text, tBeg, sBeg, qBeg, qMid, seed);
+      equalRange2(sa, beg, end, text, tBeg, sBeg, qBeg, qMid, seed);
     } else {
-      beg = lowerBound2(sufArray, beg, end,
+      beg = lowerBound2(sa, beg, end,
 			text, tBeg, sBeg, qBeg, qMid, seed);
-      end = upperBound2(sufArray, end + 1, end + maxHits + 1,
+      end = upperBound2(sa, end + 1, end + maxHits + 1,
 			text, tEndOld, sEndOld, qEndOld, qMid, seed);
     }
   } else {
     qMid = std::max(qEnd, qBegOld) + 1;
     subsetMap = seed.nextMap(qEnd > qBegOld ? sEnd : sBegOld);
     if (qMid > qBeg) {
-      equalRange2(sufArray, beg, end, text, tEnd, sEnd, qEnd, qMid, seed);
+      equalRange2(sa, beg, end, text, tEnd, sEnd, qEnd, qMid, seed);
     } else {
-      beg = lowerBound2(sufArray, beg - maxHits - 1, beg - 1,
+      beg = lowerBound2(sa, beg - maxHits - 1, beg - 1,
 			text, tBegOld, sBegOld, qBegOld, qMid, seed);
-      end = upperBound2(sufArray, beg, end,
+      end = upperBound2(sa, beg, end,
 			text, tEnd, sEnd, qEnd, qMid, seed);
     }
   }
@@ -322,13 +320,15 @@ static size_t equalRange3(ConstPackedArray sufArray, size_t &beg, size_t &end,
 void SubsetSuffixArray::match(size_t &beg, size_t &end,
 			      const uchar *queryPtr, BigSeq text,
 			      unsigned seedNum, size_t maxHits,
-			      size_t minDepth, size_t maxDepth) const {
+			      size_t minDepth, size_t maxDepth,
+			      size_t maxBucketHits) const {
   // the next line is unnecessary, but makes it faster in some cases:
   if( maxHits == 0 && minDepth < maxDepth ) minDepth = maxDepth;
 
   size_t depth = 0;
   const CyclicSubsetSeed &seed = seeds[seedNum];
   const uchar* subsetMap = seed.firstMap();
+  SortedSuffixes sa = sortedSuffixes(seedNum);
 
   // match using buckets:
   size_t bucketDepth = maxBucketPrefix(seedNum);
@@ -347,6 +347,11 @@ void SubsetSuffixArray::match(size_t &beg, size_t &end,
   beg = getItem(bckArray, bucketIdx);
   end = getItem(bckArray, bucketIdx + myBucketSteps[depth]);
 
+  if (end - beg > maxBucketHits) {  // too repetitive: skip it
+    beg = end;
+    return;
+  }
+
   while( depth > minDepth && end - beg < maxHits ){
     // maybe we lengthened the match too far: try shortening it again
     const uchar* oldMap = seed.prevMap( subsetMap );
@@ -375,13 +380,13 @@ void SubsetSuffixArray::match(size_t &beg, size_t &end,
       ++depth;
       subsetMap = seed.nextMap( subsetMap );
     }
-    equalRange2(sufArray, beg, end, text, d, s,
+    equalRange2(sa, beg, end, text, d, s,
 		queryPtr + d, queryPtr + depth, seed);
   }
 
   if (end - beg > maxHits * 2 && maxDepth + 1 == 0 &&
       childTable.empty() && kiddyTable.empty() && chibiTable.empty()) {
-    depth += equalRange3(sufArray, beg, end, subsetMap,
+    depth += equalRange3(sa, beg, end, subsetMap,
 			 text, depth, queryPtr + depth, seed, maxHits);
   }
 
@@ -394,18 +399,39 @@ void SubsetSuffixArray::match(size_t &beg, size_t &end,
       break;
     }
     const uchar *textSubsetMap = seed.originalSubsetMap(subsetMap);
-    childRange(beg, end, childDirection, text + depth, textSubsetMap, subset);
+    childRange(beg, end, childDirection, sa, text, depth,
+	       textSubsetMap, subset);
     ++depth;
     subsetMap = seed.nextMap( subsetMap );
   }
 }
 
+size_t SubsetSuffixArray::bucketIndex(const uchar *queryPtr,
+				      unsigned seedNum) const {
+  const CyclicSubsetSeed &seed = seeds[seedNum];
+  const uchar *subsetMap = seed.firstMap();
+  size_t bucketDepth = maxBucketPrefix(seedNum);
+  size_t bucketIdx = bucketEnds[seedNum];
+  const size_t *myBucketSteps = bucketStepEnds[seedNum];
+
+  for (size_t depth = 0; depth < bucketDepth; ) {
+    uchar subset = subsetMap[queryPtr[depth]];
+    if (subset == CyclicSubsetSeed::DELIMITER) break;
+    ++depth;
+    bucketIdx += subset * myBucketSteps[depth];
+    subsetMap = seed.nextMap(subsetMap);
+  }
+
+  return bucketIdx;
+}
+
 void SubsetSuffixArray::countMatches(std::vector<unsigned long long> &counts,
 				     const uchar *queryPtr, BigSeq text,
 				     unsigned seedNum, size_t maxDepth) const {
   size_t depth = 0;
   const CyclicSubsetSeed &seed = seeds[seedNum];
   const uchar* subsetMap = seed.firstMap();
+  SortedSuffixes sa = sortedSuffixes(seedNum);
 
   // match using buckets:
   size_t bucketDepth = maxBucketPrefix(seedNum);
@@ -439,7 +465,8 @@ void SubsetSuffixArray::countMatches(std::vector<unsigned long long> &counts,
     uchar subset = subsetMap[ queryPtr[depth] ];
     if( subset == CyclicSubsetSeed::DELIMITER ) return;
     const uchar *textSubsetMap = seed.originalSubsetMap(subsetMap);
-    childRange(beg, end, childDirection, text + depth, textSubsetMap, subset);
+    childRange(beg, end, childDirection, sa, text, depth,
+	       textSubsetMap, subset);
     ++depth;
     subsetMap = seed.nextMap( subsetMap );
   }
@@ -447,14 +474,15 @@ void SubsetSuffixArray::countMatches(std::vector<unsigned long long> &counts,
 
 void SubsetSuffixArray::childRange(size_t &beg, size_t &end,
 				   ChildDirection &childDirection,
-				   BigPtr textBase, const uchar *subsetMap,
-				   uchar subset) const {
+				   const SortedSuffixes &sa,
+				   BigSeq text, size_t depth,
+				   const uchar *subsetMap, uchar subset) const {
   if( childDirection == UNKNOWN ){
     size_t mid = getChildForward( beg );
     if( mid == beg ){  // failure: never happens with the full childTable
       mid = getChildReverse( end );
       if( mid == end ){  // failure: never happens with the full childTable
-	fastEqualRange(sufArray, beg, end, textBase, subsetMap, subset);
+	fastEqualRange(sa, beg, end, text, depth, subsetMap, subset);
 	return;
       }
       childDirection = REVERSE;
@@ -464,17 +492,17 @@ void SubsetSuffixArray::childRange(size_t &beg, size_t &end,
   }
 
   if( childDirection == FORWARD ){
-    uchar e = subsetMap[textBase[getItem(sufArray, end - 1)]];
+    uchar e = sa.subset(end - 1, depth, text, subsetMap);
     if( subset > e ){ beg = end; return; }
     if( subset < e ) childDirection = REVERSE;  // flip it for next time
     while( 1 ){
-      uchar b = subsetMap[textBase[getItem(sufArray, beg)]];
+      uchar b = sa.subset(beg, depth, text, subsetMap);
       if( subset < b ) { end = beg; return; }
       if( b == e ) return;
       size_t mid = getChildForward( beg );
       if( mid == beg ){  // failure: never happens with the full childTable
 	size_t offset = kiddyTable.empty() ? UCHAR_MAX : USHRT_MAX;
-	equalRange(sufArray, beg, end, textBase, subsetMap, subset,
+	equalRange(sa, beg, end, text, depth, subsetMap, subset,
 		   b, e, offset, 1);
 	return;
       }
@@ -483,17 +511,17 @@ void SubsetSuffixArray::childRange(size_t &beg, size_t &end,
       if( b + 1 == e ) return;  // unnecessary, but may be faster
     }
   }else{
-    uchar b = subsetMap[textBase[getItem(sufArray, beg)]];
+    uchar b = sa.subset(beg, depth, text, subsetMap);
     if( subset < b ) { end = beg; return; }
     if( subset > b ) childDirection = FORWARD;  // flip it for next time
     while( 1 ){
-      uchar e = subsetMap[textBase[getItem(sufArray, end - 1)]];
+      uchar e = sa.subset(end - 1, depth, text, subsetMap);
       if( subset > e ){ beg = end; return; }
       if( b == e ) return;
       size_t mid = getChildReverse( end );
       if( mid == end ){  // failure: never happens with the full childTable
 	size_t offset = kiddyTable.empty() ? UCHAR_MAX : USHRT_MAX;
-	equalRange(sufArray, beg, end, textBase, subsetMap, subset,
+	equalRange(sa, beg, end, text, depth, subsetMap, subset,
 		   b, e, 1, offset);
 	return;
       }
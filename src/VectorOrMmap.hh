@@ -27,6 +27,8 @@ struct VectorOrMmap{
   const T& back()  const { return v.empty() ? m.back()  : v.back();  }
 
   const T& operator[](size_t i) const { return v.empty() ? m[i] : v[i]; }
+
+  void swap(VectorOrMmap &x) { v.swap(x.v); m.swap(x.m); }
 };
 
 }  // end namespace
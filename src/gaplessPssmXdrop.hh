@@ -19,10 +19,11 @@ namespace cbrc {
 
 using namespace mcf;
 
-static void gaplessPssmXdropScores(BigPtr seq, const ScoreMatrixRow *pssm,
+template<typename Ptr>
+static void gaplessPssmXdropScores(Ptr seq, const ScoreMatrixRow *pssm,
 				   int maxScoreDrop,
 				   int &fwdScore, int &revScore) {
-  BigPtr fwd = seq;
+  Ptr fwd = seq;
   const ScoreMatrixRow *fmat = pssm;
 
   int fScore = 0, f = 0;
@@ -46,7 +47,8 @@ static void gaplessPssmXdropScores(BigPtr seq, const ScoreMatrixRow *pssm,
   revScore = rScore;
 }
 
-static bool gaplessPssmXdropEnds(BigSeq seq, const ScoreMatrixRow *pssm,
+template<typename Ptr>
+static bool gaplessPssmXdropEnds(Ptr seq, const ScoreMatrixRow *pssm,
 				 int maxScoreDrop, int fwdScore, int revScore,
 				 size_t &pos1, size_t &pos2, size_t &length) {
   size_t beg1 = pos1;
@@ -72,7 +74,8 @@ static bool gaplessPssmXdropEnds(BigSeq seq, const ScoreMatrixRow *pssm,
   return true;
 }
 
-static int gaplessPssmXdropOverlap(BigPtr seq,
+template<typename Ptr>
+static int gaplessPssmXdropOverlap(Ptr seq,
 				   const ScoreMatrixRow *pssm,
 				   int maxScoreDrop,
 				   size_t &reverseLength,
@@ -81,7 +84,7 @@ static int gaplessPssmXdropOverlap(BigPtr seq,
   int maxScore = 0;
   int score = 0;
 
-  BigPtr rs = seq;
+  Ptr rs = seq;
   const ScoreMatrixRow *rp = pssm;
   while (true) {
     int s = (*--rp)[getPrev(rs)];
@@ -108,7 +111,8 @@ static int gaplessPssmXdropOverlap(BigPtr seq,
   return score;
 }
 
-static int gaplessPssmAlignmentScore(BigPtr seq,
+template<typename Ptr>
+static int gaplessPssmAlignmentScore(Ptr seq,
 				     const ScoreMatrixRow *pssm,
 				     size_t length) {
   int score = 0;
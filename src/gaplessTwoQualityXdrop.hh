@@ -21,12 +21,13 @@ using namespace mcf;
 
 typedef unsigned char uchar;
 
-static void gaplessTwoQualityXdropScores(BigPtr seq1, const uchar *qual1,
+template<typename Ptr>
+static void gaplessTwoQualityXdropScores(Ptr seq1, const uchar *qual1,
 					 const uchar *seq2, const uchar *qual2,
 					 const TwoQualityScoreMatrix &m,
 					 int maxScoreDrop,
 					 int &fwdScore, int &revScore) {
-  BigPtr fwd1 = seq1;
+  Ptr fwd1 = seq1;
   const uchar *fwd2 = seq2;
   const uchar *fqua1 = qual1;
   const uchar *fqua2 = qual2;
@@ -52,7 +53,8 @@ static void gaplessTwoQualityXdropScores(BigPtr seq1, const uchar *qual1,
   revScore = rScore;
 }
 
-static bool gaplessTwoQualityXdropEnds(BigSeq seq1, const uchar *qual1,
+template<typename Ptr>
+static bool gaplessTwoQualityXdropEnds(Ptr seq1, const uchar *qual1,
 				       const uchar *seq2, const uchar *qual2,
 				       const TwoQualityScoreMatrix &m,
 				       int maxScoreDrop,
@@ -92,7 +94,8 @@ static bool gaplessTwoQualityXdropEnds(BigSeq seq1, const uchar *qual1,
   return true;
 }
 
-static int gaplessTwoQualityXdropOverlap(BigPtr seq1,
+template<typename Ptr>
+static int gaplessTwoQualityXdropOverlap(Ptr seq1,
 					 const uchar *qual1,
 					 const uchar *seq2,
 					 const uchar *qual2,
@@ -104,7 +107,7 @@ static int gaplessTwoQualityXdropOverlap(BigPtr seq1,
   int maxScore = 0;
   int score = 0;
 
-  BigPtr rs1 = seq1;
+  Ptr rs1 = seq1;
   const uchar *rq1 = qual1;
   const uchar *rs2 = seq2;
   const uchar *rq2 = qual2;
@@ -135,7 +138,8 @@ static int gaplessTwoQualityXdropOverlap(BigPtr seq1,
   return score;
 }
 
-static int gaplessTwoQualityAlignmentScore(BigPtr seq1,
+template<typename Ptr>
+static int gaplessTwoQualityAlignmentScore(Ptr seq1,
 					   const uchar *qual1,
 					   const uchar *seq2,
 					   const uchar *qual2,
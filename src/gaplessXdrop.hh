@@ -24,10 +24,11 @@ typedef unsigned char uchar;
 // -maxScoreDrop.  The score might suffer overflow, for huge sequences
 // and/or huge scores.  If the function detects this (not guaranteed),
 // it throws an exception.
-static void gaplessXdropScores(BigPtr seq1, const uchar *seq2,
+template<typename Ptr>
+static void gaplessXdropScores(Ptr seq1, const uchar *seq2,
 			       const ScoreMatrixRow *scorer, int maxScoreDrop,
 			       int &fwdScore, int &revScore) {
-  BigPtr fwd1 = seq1;
+  Ptr fwd1 = seq1;
   const uchar *fwd2 = seq2;
 
   int fScore = 0, f = 0;
@@ -52,7 +53,8 @@ static void gaplessXdropScores(BigPtr seq1, const uchar *seq2,
 // Find the shortest forward extension from (pos1, pos2) with score
 // "fwdScore", and the shortest reverse extension with score
 // "revScore".  Return the start coordinates and length of this alignment.
-static bool gaplessXdropEnds(BigSeq seq1, const uchar *seq2,
+template<typename Ptr>
+static bool gaplessXdropEnds(Ptr seq1, const uchar *seq2,
 			     const ScoreMatrixRow *scorer, int maxScoreDrop,
 			     int fwdScore, int revScore,
 			     size_t &pos1, size_t &pos2, size_t &length) {
@@ -94,7 +96,8 @@ static bool gaplessXdropEnds(BigSeq seq1, const uchar *seq2,
 // sentinel indicating a sequence end).  If the alignment would have
 // any region with score < -maxScoreDrop, -INF is returned and the
 // extension lengths are not set.
-static int gaplessXdropOverlap(BigPtr seq1,
+template<typename Ptr>
+static int gaplessXdropOverlap(Ptr seq1,
 			       const uchar *seq2,
 			       const ScoreMatrixRow *scorer,
 			       int maxScoreDrop,
@@ -104,7 +107,7 @@ static int gaplessXdropOverlap(BigPtr seq1,
   int maxScore = 0;
   int score = 0;
 
-  BigPtr r1 = seq1;
+  Ptr r1 = seq1;
   const uchar *r2 = seq2;
   while (true) {
     int s = scorer[getPrev(r1)][*--r2];
@@ -133,7 +136,8 @@ static int gaplessXdropOverlap(BigPtr seq1,
 
 // Calculate the score of the gapless alignment starting at (seq1,
 // seq2) with the given length.
-static int gaplessAlignmentScore(BigPtr seq1, const uchar *seq2,
+template<typename Ptr>
+static int gaplessAlignmentScore(Ptr seq1, const uchar *seq2,
 				 const ScoreMatrixRow *scorer, size_t length) {
   int score = 0;
   while (length--) score += scorer[getNext(seq1)][*seq2++];
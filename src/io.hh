@@ -6,8 +6,14 @@
 #include <string>
 #include <stdexcept>
 #include <fstream>
+#include <vector>
+#include <algorithm>  // max, min
 #include <cassert>
 
+#ifdef HAS_CXX_THREADS
+#include <thread>
+#endif
+
 namespace cbrc{
 
 template<typename T>  // T should be a vector-iterator or a pointer
@@ -33,6 +39,55 @@ void memoryToBinaryFile( T beg, T end, const std::string& fileName ){
   if( !file ) throw std::runtime_error( "can't write file: " + fileName );
 }
 
+// A block of memory, to be written to a binary file
+struct MemoryFile {
+  const char *beg;
+  const char *end;
+  std::string name;
+};
+
+template<typename T>  // T should be a vector-iterator or a pointer
+void addMemoryFile( std::vector<MemoryFile>& files,
+		    T beg, T end, const std::string& fileName ){
+  if( beg == end ) return;
+  MemoryFile f = { (const char*)&(*beg), (const char*)&(*end), fileName };
+  files.push_back( f );
+}
+
+inline void writeSomeMemoryFiles( const std::vector<MemoryFile>* files,
+				  size_t numOfThreads, size_t threadNum,
+				  std::string* error ){
+  try{
+    for( size_t i = threadNum; i < files->size(); i += numOfThreads ){
+      const MemoryFile& f = (*files)[i];
+      memoryToBinaryFile( f.beg, f.end, f.name );
+    }
+  }catch( const std::exception& e ){
+    *error = e.what();
+  }
+}
+
+// Write the files simultaneously, using up to numOfThreads threads
+inline void memoryToBinaryFiles( const std::vector<MemoryFile>& files,
+				 size_t numOfThreads ){
+  numOfThreads = std::max( std::min( numOfThreads, files.size() ),
+			   size_t(1) );
+  std::vector<std::string> errors( numOfThreads );
+#ifdef HAS_CXX_THREADS
+  std::vector<std::thread> threads( numOfThreads - 1 );
+  for( size_t i = 1; i < numOfThreads; ++i )
+    threads[i - 1] = std::thread( writeSomeMemoryFiles, &files,
+				  numOfThreads, i, &errors[i] );
+#endif
+  writeSomeMemoryFiles( &files, numOfThreads, 0, &errors[0] );
+#ifdef HAS_CXX_THREADS
+  for( size_t i = 1; i < numOfThreads; ++i )
+    threads[i - 1].join();
+#endif
+  for( size_t i = 0; i < numOfThreads; ++i )
+    if( !errors[i].empty() ) throw std::runtime_error( errors[i] );
+}
+
 }
 
 #endif
@@ -24,6 +24,8 @@
 #include "stringify.hh"
 #include "threadUtil.hh"
 #include "split/mcf_last_splitter.hh"
+#include "mcf_lru_cache.hh"
+#include "mcf_sam_output.hh"
 
 #include <math.h>
 #include <signal.h>
@@ -48,11 +50,23 @@ using namespace cbrc;
 
 typedef unsigned long long countT;
 
+struct RecordedAlignment {  // for reuse with duplicate queries
+  Alignment aln;
+  AlignmentExtras extras;
+};
+
+typedef std::vector<RecordedAlignment> RecordedAlignments;
+
+struct QueryResult {  // the alignments of each strand of one query
+  RecordedAlignments strands[2];
+};
+
 struct LastAligner {  // data that changes between queries
   Aligners engines;
   LastSplitter splitter;
   std::vector<int> qualityPssm;
   std::vector<AlignmentText> textAlns;
+  RecordedAlignments *recordedAlns;  // or null: don't record
   std::vector< std::vector<countT> > matchCounts;  // used if outputType == 0
   countT numOfNormalLetters;
   countT numOfSequences;
@@ -94,6 +108,8 @@ struct SeqData {
 namespace {
   std::mutex inputMutex;
   std::mutex outputMutex;
+  std::mutex busyThreadsMutex;
+  size_t numOfBusyThreads;  // so --split-query uses only idle threads
 
   char **querySequenceFileNames;
   mcf::izstream querySequenceFile;
@@ -114,6 +130,7 @@ namespace {
   std::vector<LastAligner> aligners;
   LastEvaluer evaluer;
   LastEvaluer gaplessEvaluer;
+  mcf::LruCache<QueryResult> queryCache;  // alignments of recent queries
   MultiSequence qrySeqsGlobal;  // sequence that hasn't been indexed by lastdb
   MultiSequence refSeqs;  // sequence that has been indexed by lastdb
   sequenceFormat::Enum referenceFormat = sequenceFormat::fasta;
@@ -521,6 +538,7 @@ struct Dispatcher{
   const TwoQualityScoreMatrix& t;
   int d;  // the maximum score drop
   int z;
+  XdropKind::Enum k;  // the kind of gapped extension
 
   Dispatcher(Phase::Enum e, const SeqData &qryData,
 	     const SubstitutionMatrices &matrices) :
@@ -534,40 +552,77 @@ struct Dispatcher{
       t( isMaskLowercase(e) ? matrices.twoQualMasked : matrices.twoQual ),
       d( (e == Phase::gapless) ? args.maxDropGapless :
          (e == Phase::pregapped ) ? args.maxDropGapped : args.maxDropFinal ),
-      z( t ? 2 : p ? 1 : 0 ){}
+      z( t ? 2 : p ? 1 : 0 ),
+      k( xdropKind(args.isGreedy, args.isBitVector, args.globality, m,
+		   scoreMatrix.maxScore, scoreMatrix.minScore, d, gapCosts,
+		   p, t, alph) ){}
+
+  // The reference sequence's element size is dispatched once per
+  // call, so that the per-letter loops don't test it
 
   int gaplessOverlap(size_t x, size_t y, size_t &rev, size_t &fwd) const {
-    if (z==0) return gaplessXdropOverlap(a+x, b+y, m, d, rev, fwd);
-    if (z==1) return gaplessPssmXdropOverlap(a+x, p+y, d, rev, fwd);
-    return gaplessTwoQualityXdropOverlap(a+x, i+x, b+y, j+y, t, d, rev, fwd);
+    return a.is4bit ? gaplessOverlap(nibblePtr(a + 0), x, y, rev, fwd)
+      :               gaplessOverlap(bytePtr(a + 0), x, y, rev, fwd);
   }
 
   void gaplessExtensionScores(size_t rPos, size_t qPos,
 			      int &fwdScore, int &revScore) const {
+    if (a.is4bit) {
+      gaplessExtensionScores(nibblePtr(a + 0), rPos, qPos, fwdScore, revScore);
+    } else {
+      gaplessExtensionScores(bytePtr(a + 0), rPos, qPos, fwdScore, revScore);
+    }
+  }
+
+  bool gaplessEnds(int fwdScore, int revScore,
+		   size_t &rPos, size_t &qPos, size_t &length) const {
+    return a.is4bit
+      ? gaplessEnds(nibblePtr(a + 0), fwdScore, revScore, rPos, qPos, length)
+      : gaplessEnds(bytePtr(a + 0), fwdScore, revScore, rPos, qPos, length);
+  }
+
+  int gaplessScore(size_t x, size_t y, size_t length) const {
+    return a.is4bit ? gaplessScore(nibblePtr(a + 0), x, y, length)
+      :               gaplessScore(bytePtr(a + 0), x, y, length);
+  }
+
+  template<typename Ptr>
+  int gaplessOverlap(Ptr s, size_t x, size_t y,
+		     size_t &rev, size_t &fwd) const {
+    if (z==0) return gaplessXdropOverlap(s+x, b+y, m, d, rev, fwd);
+    if (z==1) return gaplessPssmXdropOverlap(s+x, p+y, d, rev, fwd);
+    return gaplessTwoQualityXdropOverlap(s+x, i+x, b+y, j+y, t, d, rev, fwd);
+  }
+
+  template<typename Ptr>
+  void gaplessExtensionScores(Ptr s, size_t rPos, size_t qPos,
+			      int &fwdScore, int &revScore) const {
     if (z == 0) {
-      gaplessXdropScores(a+rPos, b+qPos, m, d, fwdScore, revScore);
+      gaplessXdropScores(s+rPos, b+qPos, m, d, fwdScore, revScore);
     } else if (z == 1) {
-      gaplessPssmXdropScores(a+rPos, p+qPos, d, fwdScore, revScore);
+      gaplessPssmXdropScores(s+rPos, p+qPos, d, fwdScore, revScore);
     } else {
-      gaplessTwoQualityXdropScores(a+rPos, i+rPos, b+qPos, j+qPos, t, d,
+      gaplessTwoQualityXdropScores(s+rPos, i+rPos, b+qPos, j+qPos, t, d,
 				   fwdScore, revScore);
     }
   }
 
-  bool gaplessEnds(int fwdScore, int revScore,
+  template<typename Ptr>
+  bool gaplessEnds(Ptr s, int fwdScore, int revScore,
 		   size_t &rPos, size_t &qPos, size_t &length) const {
-    return (z == 0) ? gaplessXdropEnds(a, b, m, d, fwdScore, revScore,
+    return (z == 0) ? gaplessXdropEnds(s, b, m, d, fwdScore, revScore,
 				       rPos, qPos, length)
-      :    (z == 1) ? gaplessPssmXdropEnds(a, p, d, fwdScore, revScore,
+      :    (z == 1) ? gaplessPssmXdropEnds(s, p, d, fwdScore, revScore,
 					   rPos, qPos, length)
-      :               gaplessTwoQualityXdropEnds(a, i, b, j, t, d, fwdScore,
+      :               gaplessTwoQualityXdropEnds(s, i, b, j, t, d, fwdScore,
 						 revScore, rPos, qPos, length);
   }
 
-  int gaplessScore(size_t x, size_t y, size_t length) const {
-    if (z==0) return gaplessAlignmentScore(a+x, b+y, m, length);
-    if (z==1) return gaplessPssmAlignmentScore(a+x, p+y, length);
-    return gaplessTwoQualityAlignmentScore(a+x, i+x, b+y, j+y, t, length);
+  template<typename Ptr>
+  int gaplessScore(Ptr s, size_t x, size_t y, size_t length) const {
+    if (z==0) return gaplessAlignmentScore(s+x, b+y, m, length);
+    if (z==1) return gaplessPssmAlignmentScore(s+x, p+y, length);
+    return gaplessTwoQualityAlignmentScore(s+x, i+x, b+y, j+y, t, length);
   }
 };
 
@@ -576,20 +631,31 @@ static bool isCollatedAlignments() {
     args.cullingLimitForFinalAlignments + 1 || numOfVolumes > 1;
 }
 
+// Do we align the queries in each batch out of order?
+static bool isSortedQueries() {
+  return args.isSortQueries && args.batchSize > 0;
+}
+
 static void writeAlignment(LastAligner &aligner, const MultiSequence &qrySeqs,
 			   const SeqData &qryData, const Alignment &aln,
 			   const AlignmentExtras &extras = AlignmentExtras()) {
   int translationType = scoreMatrix.isCodonCols() ? 2 : args.isTranslated();
+  int format = args.isSplit ? 'm' : args.outputFormat;
   AlignmentText a = aln.write(refSeqs, qrySeqs, qryData.seqNum, qryData.seq,
 			      alph, queryAlph,
 			      translationType, geneticCode.getCodonToAmino(),
-			      evaluer, args.outputFormat, extras);
-  if (isCollatedAlignments() || aligners.size() > 1 || args.isSplit) {
+			      evaluer, format, extras);
+  if (isCollatedAlignments() || aligners.size() > 1 || args.isSplit ||
+      isSortedQueries()) {
     aligner.textAlns.push_back(a);
   } else {
     std::cout << a.text;
     delete[] a.text;
   }
+  if (aligner.recordedAlns) {
+    RecordedAlignment r = {aln, extras};
+    aligner.recordedAlns->push_back(r);
+  }
 }
 
 static void writeSegmentPair(LastAligner &aligner,
@@ -607,18 +673,40 @@ struct GaplessAlignmentCounts {
   size_t maxSignificantAlignments;
 };
 
+struct GaplessHit {  // a seed hit that was skipped, or gave an alignment
+  size_t qryPos;
+  size_t refPos;
+  bool isAlignment;
+};
+
+// Get a gapless alignment through a seed hit, if it scores high enough
+static bool gaplessExtension(const Dispatcher &dis, size_t refPos,
+			     size_t qryPos, SegmentPair &sp) {
+  int fwdScore, revScore;
+  dis.gaplessExtensionScores(refPos, qryPos, fwdScore, revScore);
+  int score = fwdScore + revScore;
+  if (score < minScoreGapless) return false;
+  size_t length;
+  if (!dis.gaplessEnds(fwdScore, revScore, refPos, qryPos, length))
+    return false;
+  sp = SegmentPair(refPos, qryPos, length, score);
+  return true;
+}
+
 // Get seed hits and gapless alignments at one query-sequence position
 void alignGapless1(LastAligner &aligner, SegmentPairPot &gaplessAlns,
 		   const MultiSequence &qrySeqs, const SeqData &qryData,
 		   const Dispatcher &dis, DiagonalTable &dt,
 		   GaplessAlignmentCounts &counts, const SubsetSuffixArray &sa,
-		   const uchar *qryPtr, unsigned seedNum) {
+		   const uchar *qryPtr, unsigned seedNum,
+		   std::vector<GaplessHit> *hits) {
   const bool isOverlap = (args.globality && args.outputType == 1);
 
   size_t beg;
   size_t end;
   sa.match(beg, end, qryPtr, dis.a, seedNum,
-	   args.oneHitMultiplicity, args.minHitDepth, args.maxHitDepth);
+	   args.oneHitMultiplicity, args.minHitDepth, args.maxHitDepth,
+	   args.maxBucketHits);
   counts.matchCount += end - beg;
 
   size_t qryPos = qryPtr - dis.b;  // coordinate in the query sequence
@@ -630,7 +718,10 @@ void alignGapless1(LastAligner &aligner, SegmentPairPot &gaplessAlns,
     // it might be faster to unpack all these refPos values at once:
     size_t refPos = sa.getPosition(beg);  // position in the reference sequence
     size_t diagonal = qryPos - refPos;
-    if (dt.isCovered(diagonal, qryPos)) continue;
+    if (dt.isCovered(diagonal, qryPos)) {
+      if (hits) hits->push_back(GaplessHit{qryPos, refPos, false});
+      continue;
+    }
     ++counts.gaplessExtensionCount;
     int score;
 
@@ -642,21 +733,16 @@ void alignGapless1(LastAligner &aligner, SegmentPairPot &gaplessAlns,
       dt.addEndpoint(diagonal, sp.end2());
       writeSegmentPair(aligner, qrySeqs, qryData, sp);
     } else {
-      int fwdScore, revScore;
-      dis.gaplessExtensionScores(refPos, qryPos, fwdScore, revScore);
-      score = fwdScore + revScore;
-      if (score < minScoreGapless) continue;
-      size_t rPos = refPos;
-      size_t qPos = qryPos;
-      size_t length;
-      if (!dis.gaplessEnds(fwdScore, revScore, rPos, qPos, length)) continue;
-      SegmentPair sp(rPos, qPos, length, score);
+      SegmentPair sp;
+      if (!gaplessExtension(dis, refPos, qryPos, sp)) continue;
+      score = sp.score;
       dt.addEndpoint(diagonal, sp.end2());
 
       if (args.outputType == 1) {  // we just want gapless alignments
 	writeSegmentPair(aligner, qrySeqs, qryData, sp);
       } else {
 	gaplessAlns.add(sp);
+	if (hits) hits->push_back(GaplessHit{qryPos, refPos, true});
       }
     }
 
@@ -668,60 +754,234 @@ void alignGapless1(LastAligner &aligner, SegmentPairPot &gaplessAlns,
   }
 }
 
-// Find query matches to the suffix array, and do gapless extensions
-void alignGapless(LastAligner &aligner, SegmentPairPot &gaplessAlns,
-		  const MultiSequence &qrySeqs, const SeqData &qryData,
-		  const Dispatcher &dis) {
+// Find query matches to the suffix array, and do gapless extensions,
+// for seeds starting in [loopBeg, loopEnd)
+static void alignGaplessRange(LastAligner &aligner,
+			      SegmentPairPot &gaplessAlns,
+			      const MultiSequence &qrySeqs,
+			      const SeqData &qryData, const Dispatcher &dis,
+			      GaplessAlignmentCounts &counts,
+			      size_t loopBeg, size_t loopEnd,
+			      std::vector<GaplessHit> *hits) {
   DiagonalTable dt;  // record already-covered positions on each diagonal
-  size_t maxAlignments =
-    args.maxAlignmentsPerQueryStrand ? args.maxAlignmentsPerQueryStrand : 1;
-  GaplessAlignmentCounts counts = {0, 0, 0, maxAlignments};
-
-  size_t loopBeg = qryData.seqBeg;
-  size_t loopEnd = seedSearchEnd(qryData.seqEnd);
 
   const uchar *querySeq = qryData.seq;
   const uchar *qryBeg = querySeq + loopBeg;
-  const uchar *qryEnd = querySeq + loopEnd;
+  const uchar *qryEnd = querySeq + seedSearchEnd(qryData.seqEnd);
 
   const unsigned wordLen = wordsFinder.wordLength;
 
   if (wordLen) {
+    const uchar *wordsEnd = std::min(querySeq + loopEnd + wordLen - 1, qryEnd);
     unsigned hash = 0;
-    qryBeg = wordsFinder.init(qryBeg, qryEnd, &hash);
-    while (qryBeg < qryEnd) {
+    qryBeg = wordsFinder.init(qryBeg, wordsEnd, &hash);
+    while (qryBeg < wordsEnd) {
       unsigned c = wordsFinder.baseToCode[*qryBeg];
       ++qryBeg;
       if (c != dnaWordsFinderNull) {
 	unsigned w = wordsFinder.next(&hash, c);
 	if (w != dnaWordsFinderNull) {
 	  alignGapless1(aligner, gaplessAlns, qrySeqs, qryData, dis, dt,
-			counts, suffixArrays[0], qryBeg - wordLen, w);
+			counts, suffixArrays[0], qryBeg - wordLen, w,
+			hits);
 	  if (counts.maxSignificantAlignments == 0) break;
 	}
       } else {
-	qryBeg = wordsFinder.init(qryBeg, qryEnd, &hash);
+	qryBeg = wordsFinder.init(qryBeg, wordsEnd, &hash);
       }
     }
   } else {
+    const size_t step = args.queryStep;
+    const size_t w = args.minimizerWindow;
+    if (w < 2) {
+      for (size_t i = loopBeg; i < loopEnd; i += step) {
+	const uchar *qryPtr = querySeq + i;
+	for (unsigned x = 0; x < numOfIndexes; ++x) {
+	  alignGapless1(aligner, gaplessAlns, qrySeqs, qryData, dis, dt,
+			counts, suffixArrays[x], qryPtr, 0, hits);
+	}
+	if (counts.maxSignificantAlignments == 0) break;
+      }
+      return;
+    }
+    // minimizers depend on the preceding w-1 positions:
+    size_t minBeg = qryData.seqBeg;
+    if (loopBeg > minBeg + w - 1) minBeg = loopBeg - (w - 1);
     std::vector<SubsetMinimizerFinder> minFinders(numOfIndexes);
     for (unsigned x = 0; x < numOfIndexes; ++x) {
-      minFinders[x].init(suffixArrays[x].getSeeds()[0], qryBeg, qryEnd);
+      minFinders[x].init(suffixArrays[x].getSeeds()[0],
+			 querySeq + minBeg, qryEnd);
     }
-    const size_t step = args.queryStep;
-    const size_t w = args.minimizerWindow;
-    for (size_t i = loopBeg; i < loopEnd; i += step) {
-      const uchar *qryPtr = querySeq + i;
+    // Get each index's minimizers in one chunk of the query, then
+    // look them up in order of query position (and index):
+    std::vector< std::vector<const uchar *> > minimizers(numOfIndexes);
+    std::vector<size_t> nexts(numOfIndexes);
+    const size_t chunkLen = 1024;
+    for (size_t i = loopBeg; i < loopEnd; i += chunkLen) {
+      const uchar *chunkEnd = querySeq + std::min(i + chunkLen, loopEnd);
       for (unsigned x = 0; x < numOfIndexes; ++x) {
-	if (w < 2 || minFinders[x].isMinimizer(suffixArrays[x].getSeeds()[0],
-					       qryPtr, qryEnd, w)) {
-	  alignGapless1(aligner, gaplessAlns, qrySeqs, qryData, dis, dt,
-			counts, suffixArrays[x], qryPtr, 0);
+	minimizers[x].clear();
+	minFinders[x].findMinimizers(suffixArrays[x].getSeeds()[0],
+				     chunkEnd, qryEnd, w, minimizers[x]);
+	nexts[x] = 0;
+      }
+      while (true) {
+	const uchar *qryPtr = chunkEnd;
+	for (unsigned x = 0; x < numOfIndexes; ++x) {
+	  if (nexts[x] < minimizers[x].size()) {
+	    qryPtr = std::min(qryPtr, minimizers[x][nexts[x]]);
+	  }
+	}
+	if (qryPtr == chunkEnd) break;
+	size_t pos = qryPtr - querySeq;
+	bool isSeedPos = (pos >= loopBeg && (pos - loopBeg) % step == 0);
+	for (unsigned x = 0; x < numOfIndexes; ++x) {
+	  if (nexts[x] < minimizers[x].size() &&
+	      minimizers[x][nexts[x]] == qryPtr) {
+	    ++nexts[x];
+	    if (isSeedPos) {
+	      alignGapless1(aligner, gaplessAlns, qrySeqs, qryData, dis, dt,
+			    counts, suffixArrays[x], qryPtr, 0, hits);
+	    }
+	  }
 	}
+	if (counts.maxSignificantAlignments == 0) return;
       }
-      if (counts.maxSignificantAlignments == 0) break;
     }
   }
+}
+
+struct GaplessWindow {  // gapless alignments from seeds in part of a query
+  SegmentPairPot gaplessAlns;
+  std::vector<GaplessHit> hits;  // in the order they were found
+  GaplessAlignmentCounts counts;
+};
+
+static void alignGaplessWindow(LastAligner &aligner,
+			       std::vector<GaplessWindow> &windows,
+			       const MultiSequence &qrySeqs,
+			       const SeqData &qryData, const Dispatcher &dis,
+			       size_t windowSize, size_t windowNum) {
+  size_t loopEnd = seedSearchEnd(qryData.seqEnd);
+  size_t beg = qryData.seqBeg + windowSize * windowNum;
+  size_t end = std::min(beg + windowSize, loopEnd);
+  GaplessWindow &w = windows[windowNum];
+  if (beg < end) {
+    alignGaplessRange(aligner, w.gaplessAlns, qrySeqs, qryData, dis,
+		      w.counts, beg, end, &w.hits);
+  }
+}
+
+// Add n threads to the busy count
+static void addBusyThreads(size_t n) {
+  std::lock_guard<std::mutex> lockGuard(busyThreadsMutex);
+  numOfBusyThreads += n;
+}
+
+static void removeBusyThreads(size_t n) {
+  std::lock_guard<std::mutex> lockGuard(busyThreadsMutex);
+  numOfBusyThreads -= n;
+}
+
+// Mark up to n of the -P threads, that are idle, as busy, and return
+// how many
+static size_t reserveIdleThreads(size_t n) {
+  std::lock_guard<std::mutex> lockGuard(busyThreadsMutex);
+  size_t numOfIdleThreads = aligners.size() > numOfBusyThreads ?
+    aligners.size() - numOfBusyThreads : 0;
+  n = std::min(n, numOfIdleThreads);
+  numOfBusyThreads += n;
+  return n;
+}
+
+// Do windows numOfThreadsLeft-1, plus multiples of numOfThreads, in
+// this thread, and the lower-numbered ones in other threads
+static void alignGaplessWindows(LastAligner &aligner,
+				std::vector<GaplessWindow> &windows,
+				const MultiSequence &qrySeqs,
+				const SeqData &qryData, const Dispatcher &dis,
+				size_t windowSize, size_t numOfThreads,
+				size_t numOfThreadsLeft) {
+#ifdef HAS_CXX_THREADS
+  if (numOfThreadsLeft > 1) {
+    std::thread t(alignGaplessWindows, std::ref(aligner), std::ref(windows),
+		  std::cref(qrySeqs), std::cref(qryData), std::cref(dis),
+		  windowSize, numOfThreads, numOfThreadsLeft - 1);
+    for (size_t i = numOfThreadsLeft - 1; i < windows.size();
+	 i += numOfThreads) {
+      alignGaplessWindow(aligner, windows, qrySeqs, qryData, dis,
+			 windowSize, i);
+    }
+    t.join();
+    return;
+  }
+#endif
+  for (size_t i = 0; i < windows.size(); i += numOfThreads) {
+    alignGaplessWindow(aligner, windows, qrySeqs, qryData, dis, windowSize, i);
+  }
+}
+
+// Find query matches to the suffix array, and do gapless extensions
+void alignGapless(LastAligner &aligner, SegmentPairPot &gaplessAlns,
+		  const MultiSequence &qrySeqs, const SeqData &qryData,
+		  const Dispatcher &dis) {
+  size_t maxAlignments =
+    args.maxAlignmentsPerQueryStrand ? args.maxAlignmentsPerQueryStrand : 1;
+  GaplessAlignmentCounts counts = {0, 0, 0, maxAlignments};
+
+  size_t loopBeg = qryData.seqBeg;
+  size_t loopEnd = seedSearchEnd(qryData.seqEnd);
+  size_t loopLen = loopEnd - loopBeg;
+
+  size_t numOfWindows = 1;
+  if (args.querySplitLength && args.outputType > 1 &&
+      args.maxAlignmentsPerQueryStrand + 1 == 0) {
+    numOfWindows = std::min(size_t(aligners.size()),
+			    loopLen / args.querySplitLength + 1);
+  }
+
+  if (numOfWindows < 2) {
+    alignGaplessRange(aligner, gaplessAlns, qrySeqs, qryData, dis, counts,
+		      loopBeg, loopEnd, 0);
+  } else {
+    // Divide the seeds between threads.  Then replay the seed hits in
+    // order, to keep the gapless alignments that a single scan would
+    // have kept: a window may have skipped hits covered by alignments
+    // that an earlier window covers
+    const size_t step = wordsFinder.wordLength ? 1 : args.queryStep;
+    size_t windowSize = (loopLen / numOfWindows + step) / step * step;
+    std::vector<GaplessWindow> windows(numOfWindows);
+    for (size_t i = 0; i < numOfWindows; ++i) windows[i].counts = counts;
+    // the number of windows doesn't depend on the idle threads, so
+    // the results don't either
+    size_t numOfThreads = 1 + reserveIdleThreads(numOfWindows - 1);
+    alignGaplessWindows(aligner, windows, qrySeqs, qryData, dis,
+			windowSize, numOfThreads, numOfThreads);
+    removeBusyThreads(numOfThreads - 1);
+    DiagonalTable dt;
+    for (size_t i = 0; i < numOfWindows; ++i) {
+      const GaplessWindow &w = windows[i];
+      const SegmentPair *alns = w.gaplessAlns.items.data();
+      for (size_t j = 0; j < w.hits.size(); ++j) {
+	const GaplessHit &h = w.hits[j];
+	SegmentPair sp;
+	if (h.isAlignment) sp = *alns++;
+	size_t diagonal = h.qryPos - h.refPos;
+	if (dt.isCovered(diagonal, h.qryPos)) continue;
+	if (!h.isAlignment) {
+	  ++counts.gaplessExtensionCount;
+	  if (!gaplessExtension(dis, h.refPos, h.qryPos, sp)) continue;
+	  ++counts.gaplessAlignmentCount;
+	}
+	dt.addEndpoint(diagonal, sp.end2());
+	gaplessAlns.add(sp);
+      }
+      counts.matchCount += w.counts.matchCount;
+      counts.gaplessExtensionCount += w.counts.gaplessExtensionCount;
+      counts.gaplessAlignmentCount += w.counts.gaplessAlignmentCount;
+    }
+    LOG2("query windows=" << numOfWindows << " threads=" << numOfThreads);
+  }
 
   LOG2( "initial matches=" << counts.matchCount );
   LOG2( "gapless extensions=" << counts.gaplessExtensionCount );
@@ -767,26 +1027,39 @@ void alignGapped(LastAligner &aligner, AlignmentPot &gappedAlns,
 
   gaplessAlns.cull( args.cullingLimitForGaplessAlignments );
   gaplessAlns.sort();  // sort by score descending, and remove duplicates
+  if (args.maxChainGap) gaplessAlns.chain(args.maxChainGap, refSeqs);
 
   LOG2( "redone gapless alignments=" << gaplessAlns.size() );
 
+  std::vector<SegmentPair> chainItems;
+
   for( size_t i = 0; i < gaplessAlns.size(); ++i ){
     SegmentPair& sp = gaplessAlns.get(i);
 
     if( SegmentPairPot::isMarked(sp) ) continue;
 
+    if (args.maxChainGap &&
+	gaplessAlns.chainScore(sp) < args.minScoreGapped) continue;
+
     Alignment aln;
     AlignmentExtras extras;  // not used
     aln.seed = sp;
 
     shrinkToLongestIdenticalRun( aln.seed, dis );
 
+    const std::vector<SegmentPair> *anchors = 0;
+    if (args.bandWidth > 0) {
+      gaplessAlns.getChain(sp, chainItems);
+      anchors = &chainItems;
+    }
+
     // do gapped extension from each end of the seed:
-    aln.makeXdrop(aligner.engines, args.isGreedy, args.scoreType,
+    aln.makeXdrop(aligner.engines, dis.k, args.scoreType,
 		  dis.a, dis.b, args.globality,
-		  dis.m, scoreMatrix.maxScore, scoreMatrix.minScore,
+		  dis.m, scoreMatrix.maxScore,
 		  dis.r, matrices.stats.lambda(), gapCosts, dis.d,
-		  qryData.frameSize, dis.p, dis.t, dis.i, dis.j, alph, extras);
+		  qryData.frameSize, dis.p, dis.t, dis.i, dis.j, alph, extras,
+		  0, 0, anchors, args.bandWidth);
     ++gappedExtensionCount;
 
     if( aln.score < args.minScoreGapped ) continue;
@@ -801,6 +1074,10 @@ void alignGapped(LastAligner &aligner, AlignmentPot &gappedAlns,
 
     gaplessAlns.markAllOverlaps( aln.blocks );
     gaplessAlns.markTandemRepeats( aln.seed, args.maxRepeatDistance );
+    if (args.maxChainGap) {
+      gaplessAlns.markChainMates(sp, aln.beg1(), aln.end1(),
+				 aln.beg2(), aln.end2());
+    }
 
     if (phase == Phase::gapped) gappedAlns.add(aln);
     else SegmentPairPot::markAsGood(sp);
@@ -819,9 +1096,9 @@ static void alignPostgapped(LastAligner &aligner, AlignmentPot &gappedAlns,
   AlignmentExtras extras;  // not used
   for (size_t i = 0; i < gappedAlns.size(); ++i) {
     Alignment &aln = gappedAlns.items[i];
-    aln.makeXdrop(aligner.engines, args.isGreedy, args.scoreType,
+    aln.makeXdrop(aligner.engines, dis.k, args.scoreType,
 		  dis.a, dis.b, args.globality,
-		  dis.m, scoreMatrix.maxScore, scoreMatrix.minScore,
+		  dis.m, scoreMatrix.maxScore,
 		  0, 0, gapCosts, dis.d,
 		  frameSize, dis.p, dis.t, dis.i, dis.j, alph, extras);
   }
@@ -841,9 +1118,9 @@ void alignFinish(LastAligner &aligner, const MultiSequence &qrySeqs,
     } else {  // calculate match probabilities:
       Alignment probAln;
       probAln.seed = aln.seed;
-      probAln.makeXdrop(aligner.engines, args.isGreedy, args.scoreType,
+      probAln.makeXdrop(aligner.engines, dis.k, args.scoreType,
 			dis.a, dis.b, args.globality,
-			dis.m, scoreMatrix.maxScore, scoreMatrix.minScore,
+			dis.m, scoreMatrix.maxScore,
 			dis.r, matrices.stats.lambda(), gapCosts, dis.d,
 			qryData.frameSize, dis.p, dis.t, dis.i, dis.j, alph,
 			extras, args.gamma, args.outputType);
@@ -1076,7 +1353,8 @@ static void tantanMaskTranslatedQuery(const SeqData &qryData) {
 void translateAndScan(LastAligner &aligner, MultiSequence &qrySeqs,
 		      SeqData &qryData, size_t chunkQryNum,
 		      size_t finalCullingLimit,
-		      const SubstitutionMatrices &matrices) {
+		      const SubstitutionMatrices &matrices,
+		      const RecordedAlignments *oldAlns) {
   std::vector<uchar> modifiedQuery;
 
   if (args.isTranslated()) {
@@ -1106,7 +1384,14 @@ void translateAndScan(LastAligner &aligner, MultiSequence &qrySeqs,
     countMatches(aligner.matchCounts[chunkQryNum], qryData);
   } else {
     size_t oldNumOfAlns = aligner.textAlns.size();
-    scan(aligner, qrySeqs, qryData, matrices);
+    if (oldAlns) {  // reuse the alignments of an identical query
+      for (size_t i = 0; i < oldAlns->size(); ++i) {
+	const RecordedAlignment &r = (*oldAlns)[i];
+	writeAlignment(aligner, qrySeqs, qryData, r.aln, r.extras);
+      }
+    } else {
+      scan(aligner, qrySeqs, qryData, matrices);
+    }
     cullFinalAlignments(aligner.textAlns, oldNumOfAlns, finalCullingLimit);
   }
 
@@ -1147,6 +1432,40 @@ static void splitAlignments(LastSplitter &splitter,
   clearAlignments(textAlns);
 }
 
+// Can we reuse alignments of earlier queries with identical sequence?
+static bool isReusableAlignments() {
+  return queryCache.isOn() && args.outputType > 0 && numOfVolumes < 2 &&
+    args.inputFormat != sequenceFormat::pssm;
+}
+
+// Get the letters & quality codes that determine a query's alignments
+static void getQueryKey(std::string &key,
+			const MultiSequence &qrySeqs, size_t qryNum) {
+  const uchar *s = qrySeqs.seqReader();
+  size_t beg = qrySeqs.seqBeg(qryNum);
+  size_t end = qrySeqs.seqEnd(qryNum);
+  key.assign(s + beg, s + end);
+  size_t qualsPerLetter = qrySeqs.qualsPerLetter();
+  if (qualsPerLetter) {
+    const uchar *q = qrySeqs.qualityReader();
+    key.append(q + beg * qualsPerLetter, q + end * qualsPerLetter);
+  }
+}
+
+static size_t bytesOf(const QueryResult &result) {
+  size_t bytes = sizeof result;
+  for (int i = 0; i < 2; ++i) {
+    const RecordedAlignments &v = result.strands[i];
+    for (size_t j = 0; j < v.size(); ++j) {
+      const RecordedAlignment &r = v[j];
+      bytes += sizeof r + r.aln.blocks.size() * sizeof(SegmentPair) +
+	r.extras.columnAmbiguityCodes.size() +
+	r.extras.expectedCounts.size() * sizeof(double);
+    }
+  }
+  return bytes;
+}
+
 static void alignOneQuery(LastAligner &aligner, MultiSequence &qrySeqs,
 			  size_t qryNum, size_t chunkQryNum,
 			  size_t finalCullingLimit, bool isFirstVolume) {
@@ -1181,29 +1500,96 @@ static void alignOneQuery(LastAligner &aligner, MultiSequence &qrySeqs,
   std::vector<AlignmentText> &textAlns = aligner.textAlns;
   size_t oldNumOfAlns = textAlns.size();
 
+  std::string key;
+  QueryResult oldResult;
+  QueryResult newResult;
+  bool isOld = false;
+  bool isNew = false;
+  if (isReusableAlignments()) {
+    getQueryKey(key, qrySeqs, qryNum);
+    isOld = queryCache.get(key, oldResult);
+    isNew = !isOld;
+  }
+
   if (args.strand == 2 && !isFirstVolume)
     qrySeqs.reverseComplementOneSequence(qryNum, queryAlph.complement);
 
-  if (args.strand != 0)
+  if (args.strand != 0) {
+    aligner.recordedAlns = isNew ? &newResult.strands[0] : 0;
     translateAndScan(aligner, qrySeqs, qryData, chunkQryNum, finalCullingLimit,
-		     fwdMatrices);
+		     fwdMatrices, isOld ? &oldResult.strands[0] : 0);
+  }
 
   if (args.strand == 2 || (args.strand == 0 && isFirstVolume))
     qrySeqs.reverseComplementOneSequence(qryNum, queryAlph.complement);
 
-  if (args.strand != 1)
+  if (args.strand != 1) {
+    aligner.recordedAlns = isNew ? &newResult.strands[1] : 0;
     translateAndScan(aligner, qrySeqs, qryData, chunkQryNum, finalCullingLimit,
-		     args.isQueryStrandMatrix ? revMatrices : fwdMatrices);
+		     args.isQueryStrandMatrix ? revMatrices : fwdMatrices,
+		     isOld ? &oldResult.strands[1] : 0);
+  }
+
+  aligner.recordedAlns = 0;
+  if (isNew) {
+    size_t bytes = bytesOf(newResult);
+    queryCache.put(key, std::move(newResult), bytes);
+  }
 
   if (numOfVolumes < 2) {
     if (isCollatedAlignments()) {
       sort(textAlns.begin() + oldNumOfAlns, textAlns.end());
     }
-    splitAlignments(aligner.splitter, textAlns, qrySeqs.qualsPerLetter());
+    if (!isSortedQueries()) {
+      splitAlignments(aligner.splitter, textAlns, qrySeqs.qualsPerLetter());
+    }
+  }
+}
+
+// Get the place in the index of the query's first seed.  Aligning
+// queries in order of this makes nearby index lookups more likely to
+// share memory caches.
+static size_t firstSeedBucket(const MultiSequence &qrySeqs, size_t qryNum) {
+  const SubsetSuffixArray &sa = suffixArrays[0];
+  const CyclicSubsetSeed &seed = sa.getSeeds()[0];
+  const uchar *seq = qrySeqs.seqReader();
+  size_t beg = qrySeqs.seqBeg(qryNum);
+  size_t end = qrySeqs.seqEnd(qryNum);
+  size_t w = args.minimizerWindow;
+  if (w > 1 && !wordsFinder.wordLength) {
+    SubsetMinimizerFinder f;
+    f.init(seed, seq + beg, seq + end);
+    while (beg < end && !f.isMinimizer(seed, seq + beg, seq + end, w)) {
+      beg += args.queryStep;
+    }
+  }
+  return sa.bucketIndex(seq + std::min(beg, end), 0);
+}
+
+static bool lessQueryNum(const AlignmentText &x, const AlignmentText &y) {
+  return x.queryNum() < y.queryNum();
+}
+
+// Put the alignments back in input order, then split each query's
+// alignments, as if we had done the queries in input order
+static void unsortQueries(LastAligner &aligner, size_t qualsPerLetter) {
+  std::vector<AlignmentText> &textAlns = aligner.textAlns;
+  stable_sort(textAlns.begin(), textAlns.end(), lessQueryNum);
+  if (!args.isSplit) return;
+  std::vector<AlignmentText> oneQuery;
+  for (size_t i = 0; i < textAlns.size(); ) {
+    size_t j = i + 1;
+    while (j < textAlns.size() &&
+	   textAlns[j].queryNum() == textAlns[i].queryNum()) ++j;
+    oneQuery.assign(textAlns.begin() + i, textAlns.begin() + j);
+    splitAlignments(aligner.splitter, oneQuery, qualsPerLetter);
+    i = j;
   }
+  textAlns.clear();
 }
 
 static size_t alignSomeQueries(size_t chunkNum, unsigned volume) {
+  addBusyThreads(1);
   size_t numOfChunks = aligners.size();
   LastAligner &aligner = aligners[chunkNum];
   size_t beg = firstSequenceInChunk(qrySeqsGlobal, numOfChunks, chunkNum);
@@ -1215,10 +1601,20 @@ static size_t alignSomeQueries(size_t chunkNum, unsigned volume) {
   if (args.outputType == 0 && isFirstVolume) {
     aligner.matchCounts.resize(end - beg);
   }
+  std::vector< std::pair<size_t, size_t> > order;  // sort key, query number
   for (size_t i = beg; i < end; ++i) {
+    size_t key = isSortedQueries() ? firstSeedBucket(qrySeqsGlobal, i) : 0;
+    order.push_back(std::make_pair(key, i));
+  }
+  if (isSortedQueries()) sort(order.begin(), order.end());
+  for (size_t k = 0; k < order.size(); ++k) {
+    size_t i = order[k].second;
     alignOneQuery(aligner, qrySeqsGlobal, i, i - beg,
 		  finalCullingLimit, isFirstVolume);
   }
+  if (isSortedQueries() && !isMultiVolume) {
+    unsortQueries(aligner, qrySeqsGlobal.qualsPerLetter());
+  }
   if (isMultiVolume && volume + 1 == numOfVolumes) {
     std::vector<AlignmentText> &textAlns = aligner.textAlns;
     cullFinalAlignments(textAlns, 0, args.cullingLimitForFinalAlignments);
@@ -1226,6 +1622,7 @@ static size_t alignSomeQueries(size_t chunkNum, unsigned volume) {
     splitAlignments(aligner.splitter, textAlns,
 		    qrySeqsGlobal.qualsPerLetter());
   }
+  removeBusyThreads(1);
   return beg;
 }
 
@@ -1323,7 +1720,9 @@ static void runOneThread(unsigned threadNum) {
 
 static void runOneThreadSafely(unsigned threadNum) {
   try {
+    addBusyThreads(1);
     runOneThread(threadNum);
+    removeBusyThreads(1);
   } catch (const std::bad_alloc &e) {
     std::cerr << args.programName << ": out of memory\n";
     raise(SIGTERM);
@@ -1428,7 +1827,38 @@ void scanAllVolumes(int bitsPerBase, int bitsPerInt) {
   }
 }
 
-void writeHeader(countT numOfRefSeqs, countT refLetters, std::ostream &out) {
+static void writeSamSequenceLines(const MultiSequence &m, size_t seqCount,
+				  std::ostream &out) {
+  for (size_t i = 0; i < seqCount; ++i) {
+    out << "@SQ\tSN:" << m.seqName(i) << "\tLN:" << m.seqLen(i) << '\n';
+  }
+}
+
+// Write SAM header lines: the "#" lines after them become @CO lines
+static void writeSamHeader(countT numOfRefSeqs, int bitsPerInt,
+			   std::ostream &out) {
+  out << "@HD\tVN:1.6\tSO:unsorted\n";
+  if (numOfVolumes > 1) {
+    for (unsigned i = 0; i < numOfVolumes; ++i) {
+      std::string baseName = args.lastdbName + stringify(i);
+      size_t seqCount = -1;
+      size_t seqLen = -1;
+      readInnerPrj(baseName + ".prj", seqCount, seqLen);
+      MultiSequence m;
+      m.namesFromFiles(baseName, seqCount, bitsPerInt == 32);
+      writeSamSequenceLines(m, seqCount, out);
+    }
+  } else {
+    writeSamSequenceLines(refSeqs, numOfRefSeqs, out);
+  }
+  out << "@PG\tID:lastal\tPN:lastal\tVN:" <<
+#include "version.hh"
+      << "\n";
+}
+
+void writeHeader(countT numOfRefSeqs, countT refLetters, int bitsPerInt,
+		 std::ostream &out) {
+  if (args.isSam()) writeSamHeader(numOfRefSeqs, bitsPerInt, out);
   out << "# LAST version " <<
 #include "version.hh"
       << "\n";
@@ -1450,7 +1880,7 @@ void writeHeader(countT numOfRefSeqs, countT refLetters, std::ostream &out) {
       out << "#\n";
     }
 
-    if( args.outputFormat != 'b' && args.outputFormat != 'B' ) {
+    if( args.outputFormat == 'm' || args.outputFormat == 't' ) {
       out << "# Coordinates are 0-based.  For - strand matches, coordinates\n";
       out << "# in the reverse complement of the 2nd sequence are used.\n";
       out << "#\n";
@@ -1502,6 +1932,8 @@ void lastal( int argc, char** argv ){
   bool isProtein = alph.isProtein();
 
   args.fromArgs( argc, argv );  // command line overrides prj file
+  if (args.isSam() && refStrand != 1)
+    ERR("can't write SAM/BAM with reverse-strand reference sequences");
 
   std::string matrixName = args.matrixName( isProtein );
   std::string matrixFile;
@@ -1527,6 +1959,7 @@ void lastal( int argc, char** argv ){
       ERR( "can't use option -l > 1: need to re-run lastdb with i <= 1" );
   }
 
+  queryCache.setMaxBytes(args.dupCacheSize);
   aligners.resize( decideNumberOfThreads( args.numOfThreads,
 					  args.programName, args.verbosity ) );
   bool isMultiVolume = (numOfVolumes + 1 > 0 && numOfVolumes > 1);
@@ -1604,7 +2037,11 @@ void lastal( int argc, char** argv ){
     numOfVolumes = 1;
   }
 
-  writeHeader(numOfRefSeqs, refLetters, std::cout);
+  mcf::SamOutputBuf samOutput;
+  if (args.isSam()) samOutput.open(std::cout, args.outputFormat == 'S', false);
+
+  if (!args.isPaf())  // PAF has no header or comment lines
+    writeHeader(numOfRefSeqs, refLetters, bitsPerInt, std::cout);
   countT queryBatchCount = 0;
 
   char defaultInputName[] = "-";
@@ -1629,7 +2066,9 @@ void lastal( int argc, char** argv ){
 	} else {
 	  if (qrySeqsGlobal.finishedSequences() == 0) throwSeqTooBig();
 	  // this enables downstream parsers to read one batch at a time:
-	  std::cout << "# batch " << queryBatchCount++ << "\n";
+	  if (!args.isSam() && !args.isPaf())
+	    std::cout << "# batch " << queryBatchCount << "\n";
+	  ++queryBatchCount;
 	  scanAllVolumes(bitsPerBase, bitsPerInt);
 	  qrySeqsGlobal.reinitForAppending();
 	  maxSeqLen = -1;
@@ -1637,7 +2076,8 @@ void lastal( int argc, char** argv ){
       }
     }
     if (qrySeqsGlobal.finishedSequences() > 0) {
-      std::cout << "# batch " << queryBatchCount << "\n";
+      if (!args.isSam() && !args.isPaf())
+	std::cout << "# batch " << queryBatchCount << "\n";
       scanAllVolumes(bitsPerBase, bitsPerInt);
     }
   }
@@ -1648,8 +2088,12 @@ void lastal( int argc, char** argv ){
     numOfSequences += aligners[i].numOfSequences;
     numOfNormalLetters += aligners[i].numOfNormalLetters;
   }
-  std::cout << "# Query sequences=" << numOfSequences
-	    << " normal letters=" << numOfNormalLetters << "\n";
+  if (args.isSam()) {
+    samOutput.close();
+  } else if (!args.isPaf()) {
+    std::cout << "# Query sequences=" << numOfSequences
+	      << " normal letters=" << numOfNormalLetters << "\n";
+  }
 }
 
 int main( int argc, char** argv )
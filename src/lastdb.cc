@@ -14,6 +14,8 @@
 #include <fstream>
 #include <iostream>
 #include <cstdlib>  // EXIT_SUCCESS, EXIT_FAILURE
+#include <exception>  // exception_ptr
+#include <functional>  // ref
 #include <numeric>  // accumulate
 
 #define ERR(x) throw std::runtime_error(x)
@@ -96,15 +98,15 @@ void writeLastalOptions( std::ostream& out, const std::string& seedText ){
       out << line << '\n';
 }
 
-void writePrjFile( const std::string& fileName, const LastdbArguments& args,
-		   const Alphabet& alph, countT sequenceCount,
-		   size_t maxSeqLen, const std::vector<countT>& letterCounts,
-		   bool isFastq, unsigned volumes, unsigned numOfIndexes,
-		   const std::string& seedText ){
+static void writePrj(std::ostream &f, const LastdbArguments &args,
+		     const Alphabet &alph, countT sequenceCount,
+		     size_t maxSeqLen, const std::vector<countT> &letterCounts,
+		     bool isFastq, unsigned volumes, unsigned numOfIndexes,
+		     const std::string &seedText,
+		     const std::vector<CyclicSubsetSeed> &seeds) {
   countT letterTotal = std::accumulate( letterCounts.begin(),
                                         letterCounts.end(), countT(0) );
 
-  std::ofstream f( fileName.c_str() );
   f << "version=" <<
 #include "version.hh"
     << '\n';
@@ -138,6 +140,16 @@ void writePrjFile( const std::string& fileName, const LastdbArguments& args,
     }
     if( volumes+1 > 0 ){
       f << "volumes=" << volumes << '\n';
+      // the volumes' indexes have these, but --append needs to check them:
+      if (args.indexStep > 1) f << "indexstep=" << args.indexStep << '\n';
+      for (size_t s = 0; s < seeds.size(); ++s) {
+	f << "seedspan=" << seeds[s].span() << '\n';
+	for (size_t i = 0; i < seeds[s].span(); ++i) {
+	  f << "subsetseed=";
+	  seeds[s].writePosition(f, i);
+	  f << '\n';
+	}
+      }
     }
     else{
       f << "numofindexes=" << numOfIndexes << '\n';
@@ -145,11 +157,83 @@ void writePrjFile( const std::string& fileName, const LastdbArguments& args,
     f << "symbolsize=" << args.bitsPerBase << '\n';
     writeLastalOptions( f, seedText );
   }
+}
 
+void writePrjFile( const std::string& fileName, const LastdbArguments& args,
+		   const Alphabet& alph, countT sequenceCount,
+		   size_t maxSeqLen, const std::vector<countT>& letterCounts,
+		   bool isFastq, unsigned volumes, unsigned numOfIndexes,
+		   const std::string& seedText,
+		   const std::vector<CyclicSubsetSeed>& seeds ){
+  std::ofstream f( fileName.c_str() );
+  writePrj(f, args, alph, sequenceCount, maxSeqLen, letterCounts, isFastq,
+	   volumes, numOfIndexes, seedText, seeds);
   f.close();
   if( !f ) ERR( "can't write file: " + fileName );
 }
 
+// Is this .prj line one that --append may change?
+static bool isPrjCountLine(const std::string &line) {
+  std::string word = line.substr(0, line.find('='));
+  return word == "numofsequences" ||
+    word == "numofletters" || word == "maxsequenceletters" ||
+    word == "letterfreqs" || word == "volumes";
+}
+
+static std::string prjSettings(std::istream &in) {
+  std::string settings, line;
+  while (getline(in, line)) {
+    if (!isPrjCountLine(line)) settings += line + '\n';
+  }
+  return settings;
+}
+
+// Get the counts from an existing multi-volume database's outer .prj
+// file, and check that its other settings are what we would write
+static void readPrjForAppending(const std::string &dbName,
+				const LastdbArguments &args,
+				const Alphabet &alph, const std::string &seedText,
+				const std::vector<CyclicSubsetSeed> &seeds,
+				unsigned &volumes, countT &sequenceCount,
+				std::vector<countT> &letterCounts,
+				size_t &maxSeqLen, bool &isFastq) {
+  std::string fileName = dbName + ".prj";
+  std::ifstream file;
+  openOrDie(file, fileName);
+  std::string text, line, word;
+  bool isSingleVolume = false;
+  isFastq = false;
+  while (getline(file, line)) {
+    text += line + '\n';
+    std::istringstream iss(line);
+    getline(iss, word, '=');
+    if (word == "numofsequences") iss >> sequenceCount;
+    if (word == "maxsequenceletters") iss >> maxSeqLen;
+    if (word == "letterfreqs") {
+      for (size_t i = 0; i < letterCounts.size(); ++i) iss >> letterCounts[i];
+    }
+    if (word == "volumes") iss >> volumes;
+    if (word == "numofindexes") isSingleVolume = true;
+    if (word == "sequenceformat") isFastq = true;
+    if (!iss) ERR("can't read file: " + fileName);
+  }
+  if (isSingleVolume) {
+    ERR("can't append to a single-volume database (make it with option -s): "
+	+ dbName);
+  }
+  if (volumes + 1 == 0) ERR("can't read file: " + fileName);
+
+  std::istringstream oldPrj(text);
+  std::ostringstream newPrj;
+  writePrj(newPrj, args, alph, 0, 0, letterCounts, isFastq, 0, 0, seedText,
+	   seeds);
+  std::istringstream newPrjIn(newPrj.str());
+  if (prjSettings(oldPrj) != prjSettings(newPrjIn)) {
+    ERR("can't append to " + dbName +
+	": it was made with a different lastdb version or options");
+  }
+}
+
 static void preprocessSomeSeqs(MultiSequence *multi,
 			       const TantanMasker *masker,
 			       const uchar *maskTable,
@@ -179,6 +263,249 @@ static void preprocessSeqs(MultiSequence &multi,
 #endif
 }
 
+// The sequence positions to index in one chunk of the sequences.
+// Positions are stored in [beg, end) of the suffix array, except
+// those near the edges, which are kept in "edgeItems" as (index,
+// position) pairs, to be stored after all threads finish.
+struct PositionsChunk {
+  size_t beg;
+  size_t end;
+  std::vector<size_t> edgeItems;
+  std::vector<size_t> prefixCounts;  // if not empty: count of each prefix
+};
+
+// The positions whose first "depth" letter-subsets have bucket
+// values in [beg, end)
+struct PrefixRange {
+  const size_t *steps;
+  int depth;
+  size_t beg;
+  size_t end;
+};
+
+static bool isIndexedPosition(SubsetMinimizerFinder &f,
+			      const CyclicSubsetSeed &seed,
+			      const uchar *beg, const uchar *end,
+			      size_t window) {
+  return (window > 1) ? f.isMinimizer(seed, beg, end, window) :
+    (seed.firstMap()[*beg] < CyclicSubsetSeed::DELIMITER);
+}
+
+// If index is null, just count the positions, else store them.  If
+// range isn't null, only use positions in that range.
+static void findSomePositions(PositionsChunk *chunk, SubsetSuffixArray *index,
+			      const MultiSequence *multi,
+			      const CyclicSubsetSeed *seed,
+			      const LastdbArguments *args,
+			      const PrefixRange *range,
+			      size_t numOfChunks, size_t chunkNum) {
+  size_t beg = firstSequenceInChunk(*multi, numOfChunks, chunkNum);
+  size_t end = firstSequenceInChunk(*multi, numOfChunks, chunkNum + 1);
+  const uchar *seq = multi->seqReader();
+  size_t window = args->minimizerWindow;
+  size_t count = chunk->beg;
+  SubsetMinimizerFinder f;
+  for (size_t i = beg; i < end; ++i) {
+    const uchar *b = seq + multi->seqBeg(i);
+    const uchar *e = seq + multi->seqEnd(i);
+    f.init(*seed, b, e);
+    while (b < e) {
+      if (isIndexedPosition(f, *seed, b, e, window)) {
+	size_t v = range ? bucketValue(*seed, seed->firstMap(), range->steps,
+				       b, range->depth) : 0;
+	if (!chunk->prefixCounts.empty()) ++chunk->prefixCounts[v];
+	if (!range || (v >= range->beg && v < range->end)) {
+	  if (index) {
+	    if (index->isPositionNearEdge(chunk->beg, chunk->end, count)) {
+	      chunk->edgeItems.push_back(count);
+	      chunk->edgeItems.push_back(b - seq);
+	    } else {
+	      index->setPosition(count, b - seq);
+	    }
+	  }
+	  ++count;
+	}
+      }
+      size_t d = e - b;
+      b += std::min(args->indexStep, d);
+    }
+  }
+  chunk->end = count;
+}
+
+static void findPositions(std::vector<PositionsChunk> &chunks,
+			  SubsetSuffixArray *index, const MultiSequence &multi,
+			  const CyclicSubsetSeed &seed,
+			  const LastdbArguments &args,
+			  const PrefixRange *range) {
+  size_t numOfChunks = chunks.size();
+#ifdef HAS_CXX_THREADS
+  std::vector<std::thread> threads(numOfChunks - 1);
+  for (size_t i = 1; i < numOfChunks; ++i)
+    threads[i - 1] = std::thread(findSomePositions, &chunks[i], index,
+				 &multi, &seed, &args, range, numOfChunks, i);
+#endif
+  findSomePositions(&chunks[0], index, &multi, &seed, &args, range,
+		    numOfChunks, 0);
+#ifdef HAS_CXX_THREADS
+  for (size_t i = 1; i < numOfChunks; ++i)
+    threads[i - 1].join();
+#endif
+}
+
+// Find the positions to index, using one seed, and store them in the
+// suffix array.  If range isn't null, only use positions in that
+// range.  Return the number of positions.
+static size_t setPositions(SubsetSuffixArray &index, const MultiSequence &multi,
+			   const CyclicSubsetSeed &seed,
+			   const LastdbArguments &args, unsigned numOfThreads,
+			   const PrefixRange *range) {
+  size_t numOfSequences = multi.finishedSequences();
+  size_t numOfChunks = std::min(size_t(numOfThreads), numOfSequences);
+  std::vector<PositionsChunk> chunks(numOfChunks);
+  LOG("counting...");
+  findPositions(chunks, 0, multi, seed, args, range);
+  size_t count = 0;
+  for (size_t i = 0; i < numOfChunks; ++i) {
+    chunks[i].beg = count;
+    count += chunks[i].end;
+    chunks[i].end = count;
+  }
+  LOG("gathering...");
+  index.resizePositions(count, multi.seqBeg(numOfSequences));
+  findPositions(chunks, &index, multi, seed, args, range);
+  for (size_t i = 0; i < numOfChunks; ++i) {
+    const std::vector<size_t> &v = chunks[i].edgeItems;
+    for (size_t j = 0; j < v.size(); j += 2) index.setPosition(v[j], v[j+1]);
+  }
+  return count;
+}
+
+// Writes items to a file in packed format (see mcf_packed_array.hh),
+// without holding them all in memory
+class PackedArrayWriter {
+public:
+  PackedArrayWriter(const std::string &fileName, int bitsPerItem)
+    : file(fileName.c_str(), std::ios::binary), fileName(fileName),
+      bitsPerItem(bitsPerItem), numOfItems(0),
+      words(numOfWordsNeededFor(bitsPerItem, blockSize)) {}
+
+  void add(size_t item) {
+    if (numOfItems == blockSize) write(blockSize * bitsPerItem / wordBits);
+    setBits(bitsPerItem, &words[0], numOfItems++, item);
+  }
+
+  void close() {
+    write(numOfWordsNeededFor(bitsPerItem, numOfItems));
+    file.close();
+    if (!file) ERR("can't write file: " + fileName);
+  }
+
+private:
+  enum { wordBits = sizeof(size_t) * CHAR_BIT, blockSize = wordBits << 12 };
+  std::ofstream file;
+  std::string fileName;
+  int bitsPerItem;
+  size_t numOfItems;
+  std::vector<size_t> words;
+
+  void write(size_t numOfWords) {
+    file.write((const char *)&words[0], numOfWords * sizeof(size_t));
+    std::fill(words.begin(), words.end(), 0);
+    numOfItems = 0;
+  }
+};
+
+// Sort the suffix array in parts, and write it to a file, so that the
+// whole suffix array is never in memory.  Each part has the positions
+// whose first few letter-subsets are in some range, so the parts are
+// in order.  Return the number of positions.
+static size_t sortIndexInParts(SubsetSuffixArray &index,
+			       const MultiSequence &multi,
+			       const CyclicSubsetSeed &seed,
+			       const LastdbArguments &args,
+			       unsigned numOfThreads,
+			       const std::string &fileName) {
+  size_t numOfSequences = multi.finishedSequences();
+  size_t textLength = multi.seqBeg(numOfSequences);
+  const uchar *seq = multi.seqReader();
+  int bitsPerItem = numOfBitsNeededFor(textLength - 1);
+  size_t maxPartSize = args.sortMemory * CHAR_BIT / bitsPerItem;
+
+  PrefixRange range;
+  range.depth = maxBucketDepth(seed, 0, 1 << 20, 0);
+  std::vector<size_t> steps(range.depth + 1);
+  makeBucketSteps(&steps[0], seed, 0, range.depth, 0);
+  range.steps = &steps[0];
+  range.beg = 0;
+  range.end = steps[0];
+
+  size_t numOfChunks = std::min(size_t(numOfThreads), numOfSequences);
+  std::vector<PositionsChunk> chunks(numOfChunks);
+  for (size_t i = 0; i < numOfChunks; ++i) {
+    chunks[i].prefixCounts.resize(steps[0]);
+  }
+  LOG("counting prefixes...");
+  findPositions(chunks, 0, multi, seed, args, &range);
+  std::vector<size_t> counts(steps[0]);
+  for (size_t i = 0; i < numOfChunks; ++i) {
+    for (size_t j = 0; j < steps[0]; ++j) {
+      counts[j] += chunks[i].prefixCounts[j];
+    }
+  }
+
+  PackedArrayWriter out(fileName, bitsPerItem);
+  size_t total = 0;
+  while (range.beg < steps[0]) {
+    size_t partSize = counts[range.beg];
+    range.end = range.beg + 1;
+    while (range.end < steps[0] &&
+	   partSize + counts[range.end] <= maxPartSize) {
+      partSize += counts[range.end++];
+    }
+    if (partSize > 0) {
+      SubsetSuffixArray part;
+      part.getSeeds().push_back(seed);
+      size_t count = setPositions(part, multi, seed, args, numOfThreads,
+				  &range);
+      LOG("sorting part with " << count << " positions...");
+      part.sortIndex(seq, 0, &count, args.minSeedLimit, 0, numOfThreads);
+      for (size_t i = 0; i < count; ++i) out.add(part.getPosition(i));
+      total += count;
+    }
+    range.beg = range.end;
+  }
+
+  out.close();
+  index.mapPositions(fileName, total, textLength);
+  return total;
+}
+
+// Divide the sequences into chunks, and count the "words" in each
+// chunk, using one thread per chunk
+static void countWords(size_t *chunkWordCounts, const uchar **chunkBegs,
+		       const DnaWordsFinder &finder, const MultiSequence &multi,
+		       size_t numOfChunks) {
+  const uchar *seq = multi.seqReader();
+  for (size_t i = 0; i <= numOfChunks; ++i) {
+    chunkBegs[i] = seq + multi.seqBeg(firstSequenceInChunk(multi,
+							    numOfChunks, i));
+  }
+  size_t *c = chunkWordCounts;
+  const size_t n = dnaWordsFinderNull + 1;
+#ifdef HAS_CXX_THREADS
+  std::vector<std::thread> threads(numOfChunks - 1);
+  for (size_t i = 1; i < numOfChunks; ++i)
+    threads[i - 1] = std::thread(&DnaWordsFinder::count, &finder,
+				 chunkBegs[i], chunkBegs[i + 1], c + i * n);
+#endif
+  finder.count(chunkBegs[0], chunkBegs[1], c);
+#ifdef HAS_CXX_THREADS
+  for (size_t i = 1; i < numOfChunks; ++i)
+    threads[i - 1].join();
+#endif
+}
+
 // Make one database volume, from one batch of sequences
 void makeVolume(std::vector<CyclicSubsetSeed>& seeds,
 		const DnaWordsFinder& wordsFinder, MultiSequence& multi,
@@ -215,75 +542,62 @@ void makeVolume(std::vector<CyclicSubsetSeed>& seeds,
 
   writePrjFile( baseName + ".prj", args, alph, numOfSequences,
 		maxSeqLen, letterCounts,
-		multi.qualsPerLetter(), -1, numOfIndexes, seedText );
+		multi.qualsPerLetter(), -1, numOfIndexes, seedText, seeds );
 
   for( unsigned x = 0; x < numOfIndexes; ++x ){
+    std::string indexName =
+      (numOfIndexes > 1) ? baseName + char('a' + x) : baseName;
     SubsetSuffixArray myIndex;
     std::vector<CyclicSubsetSeed> &indexSeeds = myIndex.getSeeds();
     size_t wordCounts[dnaWordsFinderNull + 1] = {0};
 
     if (wordsFinder.wordLength) {
-      const uchar *seqEnd = seq + textLength;
+      size_t numOfChunks = std::min(size_t(numOfThreads), numOfSequences);
+      std::vector<const uchar *> chunkBegs(numOfChunks + 1);
+      std::vector<size_t> chunkWordCounts(numOfChunks * (dnaWordsFinderNull+1));
       LOG("counting...");
-      wordsFinder.count(seq, seqEnd, wordCounts);
+      countWords(&chunkWordCounts[0], &chunkBegs[0], wordsFinder, multi,
+		 numOfChunks);
+      for (size_t i = 0; i < chunkWordCounts.size(); ++i) {
+	wordCounts[i % (dnaWordsFinderNull + 1)] += chunkWordCounts[i];
+      }
       std::partial_sum(wordCounts, wordCounts + seeds.size(), wordCounts);
       LOG("gathering...");
       seeds.swap(indexSeeds);
-      myIndex.setWordPositions(wordsFinder, wordCounts, seq, seqEnd);
+      myIndex.setWordPositions(wordsFinder, wordCounts, &chunkWordCounts[0],
+			       seq, &chunkBegs[0], numOfChunks);
     } else {
       indexSeeds.resize(1);
       seeds[x].swap(indexSeeds[0]);
-      SubsetMinimizerFinder f;
-      size_t window = args.minimizerWindow;
-      const CyclicSubsetSeed &seed = indexSeeds[0];
-      const uchar *subsetMap = seed.firstMap();
-      size_t count = 0;
-      LOG("counting...");
-      for (size_t i = 0; i < numOfSequences; ++i) {
-	const uchar *beg = seq + multi.seqBeg(i);
-	const uchar *end = seq + multi.seqEnd(i);
-	f.init(seed, beg, end);
-	while (beg < end) {
-	  count += (window > 1) ? f.isMinimizer(seed, beg, end, window) :
-	    (subsetMap[*beg] < CyclicSubsetSeed::DELIMITER);
-	  size_t d = end - beg;
-	  beg += std::min(args.indexStep, d);
-	}
-      }
-      LOG("gathering...");
-      myIndex.resizePositions(count, textLength);
-      count = 0;
-      for (size_t i = 0; i < numOfSequences; ++i) {
-	const uchar *beg = seq + multi.seqBeg(i);
-	const uchar *end = seq + multi.seqEnd(i);
-	f.init(seed, beg, end);
-	while (beg < end) {
-	  if ((window > 1) ? f.isMinimizer(seed, beg, end, window) :
-	      (subsetMap[*beg] < CyclicSubsetSeed::DELIMITER))
-	    myIndex.setPosition(count++, beg - seq);
-	  size_t d = end - beg;
-	  beg += std::min(args.indexStep, d);
-	}
+      if (args.sortMemory) {
+	wordCounts[0] = sortIndexInParts(myIndex, multi, indexSeeds[0], args,
+					 numOfThreads, indexName + ".suf");
+      } else {
+	wordCounts[0] = setPositions(myIndex, multi, indexSeeds[0], args,
+				     numOfThreads, 0);
       }
-      wordCounts[0] = count;
     }
 
-    LOG( "sorting..." );
-    myIndex.sortIndex(seq, wordsFinder.wordLength, wordCounts,
-		      args.minSeedLimit, args.childTableType, numOfThreads);
+    if (!args.sortMemory) {
+      LOG( "sorting..." );
+      myIndex.sortIndex(seq, wordsFinder.wordLength, wordCounts,
+			args.minSeedLimit, args.childTableType, numOfThreads);
+    }
 
     LOG( "bucketing..." );
     myIndex.makeBuckets(seq, wordsFinder.wordLength, wordCounts,
 			args.minIndexedPositionsPerBucket, args.bucketDepth,
 			numOfThreads);
 
-    LOG( "writing..." );
-    if( numOfIndexes > 1 ){
-      myIndex.toFiles( baseName + char('a' + x), false, textLength );
-    } else {
-      myIndex.toFiles( baseName, true, textLength );
+    if (args.prefixCacheWidth) {
+      LOG("caching prefixes...");
+      myIndex.makePrefixCache(seq, textLength, args.prefixCacheWidth,
+			      numOfThreads);
     }
 
+    LOG( "writing..." );
+    myIndex.toFiles( indexName, numOfIndexes < 2, textLength, numOfThreads );
+
     if (wordsFinder.wordLength) {
       seeds.swap(indexSeeds);
     } else {
@@ -292,10 +606,96 @@ void makeVolume(std::vector<CyclicSubsetSeed>& seeds,
   }
 
   if (args.bitsPerBase == 4) multi.convertTo4bit();
-  multi.toFiles(baseName, args.bitsPerBase == 4);
+  multi.toFiles(baseName, args.bitsPerBase == 4, numOfThreads);
   LOG( "done!" );
 }
 
+// Makes a database volume in a background thread, so that we can read
+// the next volume's sequences at the same time
+struct VolumeMaker {
+  MultiSequence multi;
+  std::exception_ptr error;
+#ifdef HAS_CXX_THREADS
+  std::thread thread;
+  ~VolumeMaker() { if (thread.joinable()) thread.join(); }
+#endif
+};
+
+static void makeVolumeInBackground(VolumeMaker &maker,
+				   std::vector<CyclicSubsetSeed>& seeds,
+				   const DnaWordsFinder& wordsFinder,
+				   const LastdbArguments& args,
+				   const Alphabet& alph,
+				   std::vector<countT>& letterCountsSeen,
+				   size_t& maxSeqLenSeen,
+				   const TantanMasker& masker,
+				   unsigned numOfThreads,
+				   const std::string& seedText,
+				   const std::string& baseName) {
+  try {
+    makeVolume(seeds, wordsFinder, maker.multi, args, alph, letterCountsSeen,
+	       maxSeqLenSeen, masker, numOfThreads, seedText, baseName);
+  } catch (...) {
+    maker.error = std::current_exception();
+  }
+}
+
+// Wait until the background volume (if any) is finished
+static void finishVolume(VolumeMaker &maker) {
+#ifdef HAS_CXX_THREADS
+  if (maker.thread.joinable()) maker.thread.join();
+#endif
+  if (maker.error) {
+    std::exception_ptr e = maker.error;
+    maker.error = std::exception_ptr();
+    std::rethrow_exception(e);
+  }
+}
+
+// Make a volume from the finished sequences, and keep the sequences
+// from keepNum onwards (which may include an unfinished sequence) for
+// the next volume.  If args.readAheadSize > 0, make the volume in a
+// background thread, using a copy of the sequences.
+static void makeVolumeAndKeep(VolumeMaker &maker, size_t keepNum,
+			      std::vector<CyclicSubsetSeed>& seeds,
+			      const DnaWordsFinder& wordsFinder,
+			      MultiSequence& multi,
+			      const LastdbArguments& args,
+			      const Alphabet& alph,
+			      std::vector<countT>& letterCountsSeen,
+			      size_t& maxSeqLenSeen,
+			      const TantanMasker& masker,
+			      unsigned numOfThreads,
+			      const std::string& seedText,
+			      const std::string& baseName) {
+#ifdef HAS_CXX_THREADS
+  if (args.readAheadSize > 0) {
+    finishVolume(maker);
+    maker.multi.swap(multi);
+    multi.reinitFrom(maker.multi, keepNum);
+    maker.thread = std::thread(makeVolumeInBackground, std::ref(maker),
+			       std::ref(seeds), std::cref(wordsFinder),
+			       std::cref(args), std::cref(alph),
+			       std::ref(letterCountsSeen), std::ref(maxSeqLenSeen),
+			       std::cref(masker), numOfThreads,
+			       std::cref(seedText), baseName);
+    return;
+  }
+#endif
+  if (keepNum < multi.finishedSequences()) {
+    // copy the kept sequences before makeVolume masks & converts them
+    MultiSequence kept;
+    kept.reinitFrom(multi, keepNum);
+    makeVolume(seeds, wordsFinder, multi, args, alph, letterCountsSeen,
+	       maxSeqLenSeen, masker, numOfThreads, seedText, baseName);
+    multi.swap(kept);
+  } else {
+    makeVolume(seeds, wordsFinder, multi, args, alph, letterCountsSeen,
+	       maxSeqLenSeen, masker, numOfThreads, seedText, baseName);
+    multi.reinitForAppending();
+  }
+}
+
 // The max number of sequence letters, such that the total volume size
 // is likely to be less than volumeSize bytes.  (This is crude, it
 // neglects memory for the sequence names, and the fact that
@@ -358,7 +758,6 @@ static void dump1(const std::string &dbName, const uchar *decode,
 }
 
 static void dump(const std::string &dbName) {
-  std::ios_base::sync_with_stdio(false);  // makes it much faster!
   std::string alphabetLetters;
   int version = 0;
   unsigned volumes = -1;
@@ -406,6 +805,10 @@ static void dump(const std::string &dbName) {
 void lastdb( int argc, char** argv ){
   LastdbArguments args;
   args.fromArgs( argc, argv );
+  // makes it much faster, but unsynced streams aren't thread-safe, so
+  // not if a background volume thread might log at the same time:
+  if (args.readAheadSize == 0 || args.verbosity == 0)
+    std::ios_base::sync_with_stdio(false);
   if (args.isDump) return dump(args.lastdbName);
 
   std::string seedText;
@@ -435,6 +838,8 @@ void lastdb( int argc, char** argv ){
 		  args.isCaseSensitive);
   if (wordsFinder.wordLength && alph.isProtein())
     err("error: word-restricted DNA seeds on protein");
+  if (wordsFinder.wordLength && args.sortMemory)
+    err("can't use --sort-memory with word-restricted seeds");
   LOG("wordLength=" << wordsFinder.wordLength);
 
   MultiSequence multi;
@@ -445,6 +850,17 @@ void lastdb( int argc, char** argv ){
   size_t maxLetters = 0;
   size_t maxSeqLen = -1;
   size_t maxSeqLenSeen = 0;
+  countT oldSequenceCount = 0;
+  bool isOldFastq = false;
+  // declared after the things its thread writes to, so that it joins
+  // the thread before they're destroyed, if we throw:
+  VolumeMaker volumeMaker;
+
+  if (args.isAppend) {
+    readPrjForAppending(args.lastdbName, args, alph, seedText, seeds,
+			volumeNumber, oldSequenceCount, letterCounts,
+			maxSeqLenSeen, isOldFastq);
+  }
 
   char defaultInputName[] = "-";
   char* defaultInput[] = { defaultInputName, 0 };
@@ -456,10 +872,17 @@ void lastdb( int argc, char** argv ){
     LOG( "reading " << *i << "..." );
 
     while (appendSequence(multi, in, maxSeqLen, args.inputFormat, alph, 0)) {
+      if (multi.unfinishedSize() > args.readAheadSize) {
+	finishVolume(volumeMaker);
+      }
       if (multi.isFinished()) {
 	encodeSequences(multi, args.inputFormat, alph, args.isKeepLowercase,
 			multi.finishedSequences() - 1);
 	if (sequenceCount == 0) {
+	  if (args.isAppend && (multi.qualsPerLetter() > 0) != isOldFastq) {
+	    ERR("can't append to " + args.lastdbName +
+		": it has different sequence quality data");
+	  }
 	  maxLetters = maxLettersPerVolume(args, wordsFinder,
 					   multi.qualsPerLetter(),
 					   seeds.size());
@@ -479,11 +902,10 @@ void lastdb( int argc, char** argv ){
 	    } else {
 	      std::string baseName =
 		args.lastdbName + stringify(volumeNumber++);
-	      makeVolume(seeds, wordsFinder, multi, args, alph, letterCounts,
-			 maxSeqLenSeen, tantanMasker, numOfThreads, seedText,
-			 baseName);
-	      if (args.bitsPerBase == 4) multi.convertTo8bit();
-	      multi.eraseAllButTheLastSequence();
+	      makeVolumeAndKeep(volumeMaker, multi.finishedSequences() - 1,
+				seeds, wordsFinder, multi, args, alph,
+				letterCounts, maxSeqLenSeen, tantanMasker,
+				numOfThreads, seedText, baseName);
 	    }
 	  }
 	  size_t lastSeq = multi.finishedSequences() - 1;
@@ -493,17 +915,19 @@ void lastdb( int argc, char** argv ){
       } else {
 	if (multi.finishedSequences() == 0) throwSeqTooBig();
 	std::string baseName = args.lastdbName + stringify(volumeNumber++);
-	makeVolume(seeds, wordsFinder, multi, args, alph, letterCounts,
-		   maxSeqLenSeen, tantanMasker, numOfThreads, seedText,
-		   baseName);
-	multi.reinitForAppending();
+	makeVolumeAndKeep(volumeMaker, multi.finishedSequences(), seeds,
+			  wordsFinder, multi, args, alph, letterCounts,
+			  maxSeqLenSeen, tantanMasker, numOfThreads, seedText,
+			  baseName);
 	maxSeqLen = -1;
       }
     }
   }
 
+  finishVolume(volumeMaker);
+
   if( multi.finishedSequences() > 0 ){
-    if( volumeNumber == 0 && !args.isCountsOnly ){
+    if( volumeNumber == 0 && !args.isCountsOnly && !args.isAppend ){
       makeVolume(seeds, wordsFinder, multi, args, alph, letterCounts,
 		 maxSeqLenSeen, tantanMasker, numOfThreads, seedText,
 		 args.lastdbName);
@@ -514,9 +938,10 @@ void lastdb( int argc, char** argv ){
 	       maxSeqLenSeen, tantanMasker, numOfThreads, seedText, baseName);
   }
 
-  writePrjFile( args.lastdbName + ".prj", args, alph, sequenceCount,
-		maxSeqLenSeen, letterCounts, multi.qualsPerLetter(),
-		volumeNumber, seeds.size(), seedText );
+  writePrjFile( args.lastdbName + ".prj", args, alph,
+		oldSequenceCount + sequenceCount, maxSeqLenSeen, letterCounts,
+		multi.qualsPerLetter() || isOldFastq,
+		volumeNumber, seeds.size(), seedText, seeds );
 }
 
 int main( int argc, char** argv )
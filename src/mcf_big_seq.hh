@@ -57,6 +57,68 @@ inline BigPtr operator+(BigSeq s, size_t i) {
   return p;
 }
 
+// Pointers to some position in a sequence, where the element size is
+// fixed at compile time, so that reading an element doesn't test
+// is4bit.  Kernels can be templated on these, and dispatched once
+// from a BigPtr or BigSeq.
+
+struct BytePtr {
+  const unsigned char *beg;
+
+  int operator[](size_t i) const { return beg[i]; }
+
+  int operator*() const { return *beg; }
+
+  BytePtr &operator+=(int i) {
+    beg += i;
+    return *this;
+  }
+};
+
+struct NibblePtr {
+  const unsigned char *beg;
+  size_t pos;
+
+  int operator[](size_t i) const { return BigSeq::from4bit(beg, pos + i); }
+
+  int operator*() const { return BigSeq::from4bit(beg, pos); }
+
+  NibblePtr &operator+=(int i) {
+    pos += i;
+    return *this;
+  }
+};
+
+inline int getNext(BytePtr &x) { return *x.beg++; }
+
+inline int getPrev(BytePtr &x) { return *--x.beg; }
+
+inline int getNext(NibblePtr &x) { return BigSeq::from4bit(x.beg, x.pos++); }
+
+inline int getPrev(NibblePtr &x) { return BigSeq::from4bit(x.beg, --x.pos); }
+
+inline BytePtr operator+(BytePtr p, size_t i) {
+  p.beg += i;
+  return p;
+}
+
+inline NibblePtr operator+(NibblePtr p, size_t i) {
+  p.pos += i;
+  return p;
+}
+
+// These assume that p.is4bit is false or true, respectively
+
+inline BytePtr bytePtr(BigPtr p) {
+  BytePtr b = {p.beg};
+  return b;
+}
+
+inline NibblePtr nibblePtr(BigPtr p) {
+  NibblePtr n = {p.beg, p.pos};
+  return n;
+}
+
 }
 
 #endif
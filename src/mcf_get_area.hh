@@ -0,0 +1,37 @@
+// Author: Martin C. Frith 2026
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Direct access to the characters that a streambuf has already read
+// into memory (its "get area"), so we can scan them in blocks rather
+// than one at a time.  The get area may be empty, e.g. for an
+// unbuffered std::cin: then the caller should read one char at a time.
+
+#ifndef MCF_GET_AREA_HH
+#define MCF_GET_AREA_HH
+
+#include <streambuf>
+
+namespace mcf {
+
+class GetArea : public std::streambuf {
+public:
+  static const char *beg(std::streambuf *b) {
+    char *(std::streambuf::*f)() const = &GetArea::gptr;
+    return (b->*f)();
+  }
+
+  static const char *end(std::streambuf *b) {
+    char *(std::streambuf::*f)() const = &GetArea::egptr;
+    return (b->*f)();
+  }
+
+  // Move past the first n chars of the get area
+  static void skip(std::streambuf *b, int n) {
+    void (std::streambuf::*f)(int) = &GetArea::gbump;
+    (b->*f)(n);
+  }
+};
+
+}
+
+#endif
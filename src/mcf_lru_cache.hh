@@ -0,0 +1,85 @@
+// Author: Martin C. Frith 2026
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// A thread-safe cache of values with string keys, which holds at most
+// a given number of bytes, and discards the least-recently-used
+// values to make room for new ones.  The caller says how many bytes
+// each value uses.
+
+#ifndef MCF_LRU_CACHE_HH
+#define MCF_LRU_CACHE_HH
+
+#include <stddef.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace mcf {
+
+template <typename T> class LruCache {
+public:
+  LruCache() : maxBytes(0), numOfBytes(0) {}
+
+  void setMaxBytes(size_t m) { maxBytes = m; }
+
+  bool isOn() const { return maxBytes > 0; }
+
+  // If the key is present, copy its value and make it most recently used
+  bool get(const std::string &key, T &value) {
+    std::lock_guard<std::mutex> lockGuard(mutex);
+    typename Map::iterator i = items.find(key);
+    if (i == items.end()) return false;
+    ages.splice(ages.begin(), ages, i->second.age);
+    value = i->second.value;
+    return true;
+  }
+
+  void put(const std::string &key, T &&value, size_t valueBytes) {
+    size_t bytes = key.size() + valueBytes + itemOverhead;
+    if (bytes > maxBytes) return;
+    std::lock_guard<std::mutex> lockGuard(mutex);
+    std::pair<typename Map::iterator, bool> p =
+      items.insert(std::make_pair(key, Item()));
+    if (!p.second) return;  // another thread put it already
+    Item &item = p.first->second;
+    item.value = std::move(value);
+    item.bytes = bytes;
+    ages.push_front(&p.first->first);
+    item.age = ages.begin();
+    numOfBytes += bytes;
+    while (numOfBytes > maxBytes) {
+      typename Map::iterator oldest = items.find(*ages.back());
+      numOfBytes -= oldest->second.bytes;
+      ages.pop_back();
+      items.erase(oldest);
+    }
+  }
+
+private:
+  // pointers to the keys in the map, most recent first (unlike map
+  // iterators, these stay valid when the map grows)
+  typedef std::list<const std::string *> Ages;
+
+  struct Item {
+    T value;
+    size_t bytes;
+    typename Ages::iterator age;
+  };
+
+  typedef std::unordered_map<std::string, Item> Map;
+
+  static const size_t itemOverhead = 96;  // approximate
+
+  size_t maxBytes;
+  size_t numOfBytes;
+  Map items;
+  Ages ages;
+  std::mutex mutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,148 @@
+// Author: Martin C. Frith 2026
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mcf_number_text.hh"
+
+#include <math.h>
+#include <stdio.h>
+
+namespace mcf {
+
+const char digitPairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+static const double powersOf10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Multiply by 10^k, with just one rounding if |k| <= 22
+static double timesPowerOf10(double x, int k) {
+  if (k >= 0) return (k < 23) ? x * powersOf10[k] : x * pow(10.0, k);
+  return (k > -23) ? x / powersOf10[-k] : x * pow(10.0, k);
+}
+
+// Round the non-negative number x to an integer, or return false if
+// it's too near a tie to be sure.  The true value may differ from x by
+// a few units in the last place.
+static bool roundSafely(double x, unsigned long long &n) {
+  double f = floor(x);
+  double d = x - f - 0.5;
+  if (fabs(d) <= x * 1e-15) return false;
+  n = f + (d > 0);
+  return true;
+}
+
+static int copyDigits(char *out, unsigned long long n) {
+  char b[24];
+  char *e = b + sizeof b;
+  char *d = writeDigitsBackwards(e, n);
+  memcpy(out, d, e - d);
+  return e - d;
+}
+
+int sprintUnsigned(char *out, unsigned long long x) {
+  int s = copyDigits(out, x);
+  out[s] = 0;
+  return s;
+}
+
+int sprintFixed(char *out, double x, int decimals) {
+  double a = fabs(x);
+  unsigned long long n;
+  if (!(a < 1e12) || decimals < 0 || decimals > 3 ||
+      !roundSafely(timesPowerOf10(a, decimals), n)) {
+    return sprintf(out, "%.*f", decimals, x);
+  }
+  char *o = out;
+  if (signbit(x)) *o++ = '-';
+  unsigned long long p = powersOf10[decimals];
+  o += copyDigits(o, n / p);
+  if (decimals) {
+    *o++ = '.';
+    char b[8];
+    writeDigitsBackwards(b + sizeof b, n % p + p);  // with a leading "1"
+    memcpy(o, b + sizeof b - decimals, decimals);
+    o += decimals;
+  }
+  *o = 0;
+  return o - out;
+}
+
+int sprintGeneral(char *out, double x, int precision) {
+  double a = fabs(x);
+  int p = (precision > 0) ? precision : 1;
+  if (!(a >= 1e-300 && a <= 1e300) || p > 15) {
+    if (a == 0) {
+      char *o = out;
+      if (signbit(x)) *o++ = '-';
+      *o++ = '0';
+      *o = 0;
+      return o - out;
+    }
+    return sprintf(out, "%.*g", precision, x);
+  }
+
+  double lo = powersOf10[p - 1];
+  double hi = powersOf10[p];
+  int e = floor(log10(a));
+  double y = timesPowerOf10(a, p - 1 - e);
+  if (y < lo) y = timesPowerOf10(a, p - 1 - --e);  // log10 was inexact
+  if (y >= hi) y = timesPowerOf10(a, p - 1 - ++e);
+
+  unsigned long long n;
+  if (!roundSafely(y, n)) return sprintf(out, "%.*g", precision, x);
+  if (n == hi) {  // rounding carried into a new digit
+    n /= 10;
+    ++e;
+  }
+
+  char digits[24];
+  copyDigits(digits, n);  // exactly p digits
+  int numOfDigits = p;
+  while (numOfDigits > 1 && digits[numOfDigits - 1] == '0') --numOfDigits;
+
+  char *o = out;
+  if (signbit(x)) *o++ = '-';
+  if (e < -4 || e >= p) {  // exponential style
+    *o++ = digits[0];
+    if (numOfDigits > 1) {
+      *o++ = '.';
+      memcpy(o, digits + 1, numOfDigits - 1);
+      o += numOfDigits - 1;
+    }
+    *o++ = 'e';
+    *o++ = (e < 0) ? '-' : '+';
+    unsigned f = (e < 0) ? -e : e;
+    if (f < 10) *o++ = '0';
+    o += copyDigits(o, f);
+  } else if (e < 0) {
+    *o++ = '0';
+    *o++ = '.';
+    memset(o, '0', -1 - e);
+    o += -1 - e;
+    memcpy(o, digits, numOfDigits);
+    o += numOfDigits;
+  } else {
+    memcpy(o, digits, e + 1);
+    o += e + 1;
+    if (numOfDigits > e + 1) {
+      *o++ = '.';
+      memcpy(o, digits + e + 1, numOfDigits - e - 1);
+      o += numOfDigits - e - 1;
+    }
+  }
+  *o = 0;
+  return o - out;
+}
+
+}
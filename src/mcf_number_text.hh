@@ -0,0 +1,48 @@
+// Author: Martin C. Frith 2026
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Fast replacements for sprintf, for writing numbers in alignment
+// output.  They give exactly the same text as sprintf: if a number is
+// too near a rounding tie to be sure, they just call sprintf.
+
+#ifndef MCF_NUMBER_TEXT_HH
+#define MCF_NUMBER_TEXT_HH
+
+#include <stddef.h>
+#include <string.h>
+
+namespace mcf {
+
+extern const char digitPairs[201];
+
+// Write x in decimal, into a char buffer ending at "end".  It writes
+// backwards from the end, 2 digits at a time.
+inline char *writeDigitsBackwards(char *end, unsigned long long x) {
+  while (x >= 100) {
+    unsigned r = x % 100;
+    x /= 100;
+    end -= 2;
+    memcpy(end, digitPairs + r * 2, 2);
+  }
+  if (x >= 10) {
+    end -= 2;
+    memcpy(end, digitPairs + x * 2, 2);
+  } else {
+    *--end = '0' + x;
+  }
+  return end;
+}
+
+// These write a null-terminated string, and return its length, like
+// sprintf(out, "%llu", x), sprintf(out, "%.*f", decimals, x), and
+// sprintf(out, "%.*g", precision, x)
+
+int sprintUnsigned(char *out, unsigned long long x);
+
+int sprintFixed(char *out, double x, int decimals);
+
+int sprintGeneral(char *out, double x, int precision);
+
+}
+
+#endif
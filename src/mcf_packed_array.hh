@@ -54,6 +54,17 @@ inline void setBits(int bitsPerItem, size_t *items, size_t i, size_t value) {
   items[q+1] = (items[q+1] & ~(ones >> 1 >> (s-1))) | (value >> 1 >> (s-1));
 }
 
+// Does setting the i-th item touch memory that may also be touched by
+// setting items outside [beg, end)?  If several threads set items in
+// disjoint ranges, such items must be set afterwards by one thread.
+inline bool isNearRangeEdge(int bitsPerItem, size_t beg, size_t end,
+			    size_t i) {
+  const int w = sizeof(size_t) * CHAR_BIT;
+  unsigned long long bpi = bitsPerItem;
+  size_t q = (i * bpi) / w;
+  return (beg > 0 && q <= ((beg - 1) * bpi) / w + 1) || q + 1 >= (end * bpi) / w;
+}
+
 // Unpack the items from "packed" into "unpacked" (xxx could be much faster)
 inline void unpackBits(int bitsPerItem, const size_t *packed, size_t *unpacked,
 		       size_t beg, size_t end) {
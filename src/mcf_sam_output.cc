@@ -0,0 +1,439 @@
+// Author: Martin C. Frith 2026
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "mcf_sam_output.hh"
+
+#include <string.h>
+
+#include <stdexcept>
+
+#define ERR(x) throw std::runtime_error(x)
+
+namespace mcf {
+
+const size_t maxBlockData = 0xff00;  // the same as htslib
+const size_t blockHeadSize = 18;
+const size_t blockTailSize = 8;
+
+static void putInt(std::string &s, unsigned long x, int bytes) {
+  for (int i = 0; i < bytes; ++i) {  // little-endian
+    s += char(x & 255);
+    x >>= 8;
+  }
+}
+
+static void putInt(char *s, unsigned long x, int bytes) {
+  for (int i = 0; i < bytes; ++i) {
+    s[i] = x & 255;
+    x >>= 8;
+  }
+}
+
+static long readInt(const char *beg, const char *end) {
+  bool isNegative = (beg < end && *beg == '-');
+  const char *p = beg + isNegative;
+  if (p == end) ERR("bad SAM integer: " + std::string(beg, end));
+  long x = 0;
+  for (; p < end; ++p) {
+    if (*p < '0' || *p > '9') ERR("bad SAM integer: " + std::string(beg, end));
+    x = x * 10 + (*p - '0');
+  }
+  return isNegative ? -x : x;
+}
+
+static bool isField(const char *beg, const char *end, char c) {
+  return end - beg == 1 && *beg == c;
+}
+
+// The BAI bin of a range, from the SAM specification
+static int reg2bin(long beg, long end) {
+  --end;
+  if (beg >> 14 == end >> 14) return ((1 << 15) - 1) / 7 + (beg >> 14);
+  if (beg >> 17 == end >> 17) return ((1 << 12) - 1) / 7 + (beg >> 17);
+  if (beg >> 20 == end >> 20) return ((1 << 9) - 1) / 7 + (beg >> 20);
+  if (beg >> 23 == end >> 23) return ((1 << 6) - 1) / 7 + (beg >> 23);
+  if (beg >> 26 == end >> 26) return ((1 << 3) - 1) / 7 + (beg >> 26);
+  return 0;
+}
+
+static int baseCode(char c) {
+  const char *codes = "=ACMGRSVTWYHKDBN";
+  if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+  const char *p = strchr(codes, c);
+  return (p && c) ? p - codes : 15;
+}
+
+SamOutputBuf::~SamOutputBuf() {
+  if (!stream) return;
+  stream->rdbuf(sink);
+  if (spool) std::fclose(spool);
+  if (isBam) deflateEnd(&z);
+}
+
+void SamOutputBuf::open(std::ostream &s, bool isBamOutput,
+			bool isHeaderLastInput) {
+  stream = &s;
+  sink = s.rdbuf();
+  spool = 0;
+  isBam = isBamOutput;
+  isHeaderLast = isHeaderLastInput;
+  isHeaderDone = false;
+
+  if (isBam) {
+    z.zalloc = Z_NULL;
+    z.zfree = Z_NULL;
+    z.opaque = Z_NULL;
+    if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+		     Z_DEFAULT_STRATEGY) != Z_OK) ERR("deflateInit2 error");
+    block.reserve(maxBlockData);
+    zBlock.resize(0x10000);
+  }
+
+  if (isHeaderLast) {
+    spool = std::tmpfile();
+    if (!spool) ERR("can't open a temporary file");
+  }
+
+  inBuf.resize(0x10000);
+  setp(&inBuf[0], &inBuf[0] + inBuf.size());
+  s.rdbuf(this);
+}
+
+void SamOutputBuf::close() {
+  consume(pbase(), pptr());
+  setp(&inBuf[0], &inBuf[0] + inBuf.size());
+  if (!partialLine.empty()) {
+    std::string line;
+    line.swap(partialLine);
+    doLine(line.data(), line.data() + line.size());
+  }
+
+  if (!isHeaderDone) {
+    flushBlock();
+    std::FILE *f = spool;
+    spool = 0;
+    writeHeader();
+    if (f) {
+      flushBlock();
+      std::rewind(f);
+      char buf[BUFSIZ];
+      size_t n;
+      while ((n = std::fread(buf, 1, sizeof buf, f)) > 0) writeOut(buf, n);
+      bool isError = std::ferror(f);
+      std::fclose(f);
+      if (isError) ERR("can't read temporary file");
+    }
+  }
+
+  if (isBam) {
+    flushBlock();
+    writeBlock(0, 0);  // end-of-file marker
+    deflateEnd(&z);
+  }
+
+  stream->rdbuf(sink);
+  stream = 0;
+}
+
+int SamOutputBuf::overflow(int c) {
+  consume(pbase(), pptr());
+  setp(&inBuf[0], &inBuf[0] + inBuf.size());
+  if (c != traits_type::eof()) {
+    *pptr() = c;
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize SamOutputBuf::xsputn(const char *s, std::streamsize n) {
+  if (n > epptr() - pptr()) {
+    consume(pbase(), pptr());
+    setp(&inBuf[0], &inBuf[0] + inBuf.size());
+    if (n >= epptr() - pptr()) {
+      consume(s, s + n);
+      return n;
+    }
+  }
+  memcpy(pptr(), s, n);
+  pbump(n);
+  return n;
+}
+
+int SamOutputBuf::sync() {
+  consume(pbase(), pptr());
+  setp(&inBuf[0], &inBuf[0] + inBuf.size());
+  return 0;
+}
+
+void SamOutputBuf::consume(const char *beg, const char *end) {
+  while (beg < end) {
+    const char *e = static_cast<const char *>(memchr(beg, '\n', end - beg));
+    if (!e) {
+      partialLine.append(beg, end);
+      return;
+    }
+    if (partialLine.empty()) {
+      doLine(beg, e);
+    } else {
+      partialLine.append(beg, e);
+      doLine(partialLine.data(), partialLine.data() + partialLine.size());
+      partialLine.clear();
+    }
+    beg = e + 1;
+  }
+}
+
+void SamOutputBuf::doLine(const char *beg, const char *end) {
+  if (beg == end) return;
+
+  if (*beg == '#' || *beg == '@') {
+    if (isHeaderDone) return;
+    if (*beg == '@') return addHeaderLine(beg, end);
+    do { ++beg; } while (beg < end && *beg == ' ');
+    if (beg == end) return;
+    otherLines += "@CO\t";
+    otherLines.append(beg, end);
+    otherLines += '\n';
+    return;
+  }
+
+  if (!isHeaderDone && !isHeaderLast) writeHeader();
+  addRecord(beg, end);
+}
+
+void SamOutputBuf::addHeaderLine(const char *beg, const char *end) {
+  std::string line(beg, end);
+  line += '\n';
+
+  if (line.compare(0, 4, "@HD\t") == 0) {
+    hdLines += line;
+  } else if (line.compare(0, 4, "@SQ\t") == 0) {
+    std::string name;
+    long length = -1;
+    size_t i = 3;
+    while (i < line.size() - 1) {
+      size_t j = line.find_first_of("\t\n", i + 1);
+      if (line.compare(i + 1, 3, "SN:") == 0)
+	name = line.substr(i + 4, j - i - 4);
+      if (line.compare(i + 1, 3, "LN:") == 0)
+	length = readInt(&line[i + 4], &line[j]);
+      i = j;
+    }
+    if (name.empty() || length < 0) ERR("bad SAM @SQ line: " + line);
+    if (refIds.count(name)) return;
+    refIds[name] = refNames.size();
+    refNames.push_back(name);
+    refLengths.push_back(length);
+    sqLines += line;
+  } else {
+    otherLines += line;
+  }
+}
+
+void SamOutputBuf::writeHeader() {
+  isHeaderDone = true;
+  std::string text = hdLines + sqLines + otherLines;
+
+  if (!isBam) return put(text.data(), text.size());
+
+  std::string h = "BAM\1";
+  putInt(h, text.size(), 4);
+  h += text;
+  putInt(h, refNames.size(), 4);
+  for (size_t i = 0; i < refNames.size(); ++i) {
+    putInt(h, refNames[i].size() + 1, 4);
+    h += refNames[i];
+    h += '\0';
+    putInt(h, refLengths[i], 4);
+  }
+  put(h.data(), h.size());
+}
+
+int SamOutputBuf::refId(const char *beg, const char *end) const {
+  if (isField(beg, end, '*')) return -1;
+  std::map<std::string, int>::const_iterator i =
+    refIds.find(std::string(beg, end));
+  if (i == refIds.end())
+    ERR("SAM reference sequence without @SQ: " + std::string(beg, end));
+  return i->second;
+}
+
+void SamOutputBuf::addRecord(const char *beg, const char *end) {
+  if (!isBam) {
+    put(beg, end - beg);
+    put("\n", 1);
+    return;
+  }
+
+  const int numOfFields = 11;
+  const char *f[numOfFields + 1];  // field starts
+  const char *e[numOfFields];  // field ends
+  const char *p = beg;
+  for (int i = 0; i < numOfFields; ++i) {
+    if (p > end) ERR("bad SAM line: " + std::string(beg, end));
+    f[i] = p;
+    const char *t = static_cast<const char *>(memchr(p, '\t', end - p));
+    e[i] = t ? t : end;
+    p = e[i] + 1;
+  }
+  f[numOfFields] = p;
+
+  size_t nameLen = e[0] - f[0];
+  if (nameLen > 254) ERR("SAM query name too long");
+  int ref = refId(f[2], e[2]);
+  long pos = readInt(f[3], e[3]) - 1;
+  long mapq = readInt(f[4], e[4]);
+  long flag = readInt(f[1], e[1]);
+  size_t seqLen = isField(f[9], e[9], '*') ? 0 : e[9] - f[9];
+  int nextRef = isField(f[6], e[6], '=') ? ref : refId(f[6], e[6]);
+  long nextPos = readInt(f[7], e[7]) - 1;
+  long tlen = readInt(f[8], e[8]);
+
+  cigarOps.clear();
+  long refLen = 0;
+  if (!isField(f[5], e[5], '*')) {
+    const char *opChars = "MIDNSHP=X";
+    const char *n = f[5];
+    for (const char *c = f[5]; c < e[5]; ++c) {
+      if (*c >= '0' && *c <= '9') continue;
+      const char *o = strchr(opChars, *c);
+      if (!o || !*c || c == n) ERR("bad SAM CIGAR: " + std::string(f[5], e[5]));
+      long len = readInt(n, c);
+      int op = o - opChars;
+      cigarOps.push_back(len << 4 | op);
+      if (op == 0 || op == 2 || op == 3 || op == 7 || op == 8) refLen += len;
+      n = c + 1;
+    }
+  }
+
+  // Too many CIGAR operations go in a CG tag, as in the specification
+  bool isLongCigar = (cigarOps.size() > 65535);
+  size_t numOfOps = isLongCigar ? 2 : cigarOps.size();
+
+  record.clear();
+  putInt(record, 0, 4);  // block_size: filled in below
+  putInt(record, ref, 4);
+  putInt(record, pos, 4);
+  putInt(record, nameLen + 1, 1);
+  putInt(record, mapq, 1);
+  putInt(record, reg2bin(pos, refLen ? pos + refLen : pos + 1), 2);
+  putInt(record, numOfOps, 2);
+  putInt(record, flag, 2);
+  putInt(record, seqLen, 4);
+  putInt(record, nextRef, 4);
+  putInt(record, nextPos, 4);
+  putInt(record, tlen, 4);
+  record.append(f[0], nameLen);
+  record += '\0';
+  if (isLongCigar) {
+    putInt(record, seqLen << 4 | 4, 4);  // S
+    putInt(record, refLen << 4 | 3, 4);  // N
+  } else {
+    for (size_t i = 0; i < numOfOps; ++i) putInt(record, cigarOps[i], 4);
+  }
+
+  for (size_t i = 0; i < seqLen; i += 2) {
+    int x = baseCode(f[9][i]) << 4;
+    if (i + 1 < seqLen) x |= baseCode(f[9][i + 1]);
+    record += char(x);
+  }
+
+  if (isField(f[10], e[10], '*')) {
+    record.append(seqLen, char(255));
+  } else {
+    if (size_t(e[10] - f[10]) != seqLen) ERR("bad SAM QUAL length");
+    for (const char *q = f[10]; q < e[10]; ++q) record += char(*q - 33);
+  }
+
+  for (p = f[numOfFields]; p < end; ) {  // optional fields
+    const char *t = static_cast<const char *>(memchr(p, '\t', end - p));
+    const char *tagEnd = t ? t : end;
+    if (tagEnd - p < 5 || p[2] != ':' || p[4] != ':')
+      ERR("bad SAM tag: " + std::string(p, tagEnd));
+    const char *v = p + 5;
+    record.append(p, 2);
+    if (p[3] == 'A') {
+      record += 'A';
+      record += *v;
+    } else if (p[3] == 'i') {
+      long x = readInt(v, tagEnd);
+      if      (x >= 0 && x < 256)              record += 'C';
+      else if (x >= -128 && x < 128)           record += 'c';
+      else if (x >= 0 && x < 65536)            record += 'S';
+      else if (x >= -32768 && x < 32768)       record += 's';
+      else if (x >= 0)                         record += 'I';
+      else                                     record += 'i';
+      char c = record.back();
+      int size = (c == 'C' || c == 'c') ? 1 : (c == 'S' || c == 's') ? 2 : 4;
+      putInt(record, x, size);
+    } else if (p[3] == 'f') {
+      float x = strtof(std::string(v, tagEnd).c_str(), 0);
+      char b[4];
+      memcpy(b, &x, 4);
+      record += 'f';
+      record.append(b, 4);
+    } else if (p[3] == 'Z' || p[3] == 'H') {
+      record += p[3];
+      record.append(v, tagEnd);
+      record += '\0';
+    } else {
+      ERR("unsupported SAM tag type: " + std::string(p, tagEnd));
+    }
+    p = tagEnd + 1;
+  }
+
+  if (isLongCigar) {
+    record += "CGBI";
+    putInt(record, cigarOps.size(), 4);
+    for (size_t i = 0; i < cigarOps.size(); ++i) putInt(record, cigarOps[i], 4);
+  }
+
+  putInt(&record[0], record.size() - 4, 4);
+  put(record.data(), record.size());
+}
+
+void SamOutputBuf::put(const char *s, size_t n) {
+  if (!isBam) return writeOut(s, n);
+  while (n > 0) {
+    size_t m = std::min(n, maxBlockData - block.size());
+    block.insert(block.end(), s, s + m);
+    if (block.size() == maxBlockData) flushBlock();
+    s += m;
+    n -= m;
+  }
+}
+
+void SamOutputBuf::writeBlock(const char *data, size_t size) {
+  if (deflateReset(&z) != Z_OK) ERR("deflateReset error");
+  char *out = &zBlock[0];
+  z.next_in = (Bytef *)data;
+  z.avail_in = size;
+  z.next_out = (Bytef *)(out + blockHeadSize);
+  z.avail_out = zBlock.size() - blockHeadSize - blockTailSize;
+  if (deflate(&z, Z_FINISH) != Z_STREAM_END) ERR("deflate error");
+
+  size_t blockSize = blockHeadSize + z.total_out + blockTailSize;
+  const char head[] = "\37\213\10\4\0\0\0\0\0\377\6\0BC\2\0";
+  memcpy(out, head, blockHeadSize - 2);
+  putInt(out + blockHeadSize - 2, blockSize - 1, 2);
+  char *tail = out + blockSize - blockTailSize;
+  putInt(tail, crc32(crc32(0, Z_NULL, 0), (const Bytef *)data, size), 4);
+  putInt(tail + 4, size, 4);
+  writeOut(out, blockSize);
+}
+
+void SamOutputBuf::flushBlock() {
+  if (block.empty()) return;
+  writeBlock(&block[0], block.size());
+  block.clear();
+}
+
+void SamOutputBuf::writeOut(const char *s, size_t n) {
+  if (spool) {
+    if (std::fwrite(s, 1, n, spool) != n) ERR("can't write temporary file");
+  } else {
+    if (sink->sputn(s, n) != std::streamsize(n)) ERR("write error");
+  }
+}
+
+}
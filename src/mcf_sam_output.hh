@@ -0,0 +1,84 @@
+// Author: Martin C. Frith 2026
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// mcf::SamOutputBuf takes SAM text written to an output stream, and
+// passes it on as SAM or BAM.  BAM is binary SAM, compressed in BGZF
+// blocks (https://samtools.github.io/hts-specs/SAMv1.pdf).
+
+// Lines starting with "#" become @CO header lines.  The header lines
+// must come before the alignment lines, unless isHeaderLast: then
+// header lines can be anywhere, and the alignments are held in a
+// temporary file until close.  Header lines after alignment lines are
+// otherwise ignored.
+
+#ifndef MCF_SAM_OUTPUT_HH
+#define MCF_SAM_OUTPUT_HH
+
+#include <zlib.h>
+
+#include <stddef.h>
+
+#include <cstdio>
+#include <map>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace mcf {
+
+class SamOutputBuf : public std::streambuf {
+public:
+  SamOutputBuf() : stream(0) {}
+
+  ~SamOutputBuf();  // stops redirecting the stream, without finishing
+
+  // Redirect the stream's output through this buffer
+  void open(std::ostream &s, bool isBam, bool isHeaderLast);
+
+  // Write all remaining output, and stop redirecting the stream
+  void close();
+
+protected:
+  int overflow(int c);
+  std::streamsize xsputn(const char *s, std::streamsize n);
+  int sync();
+
+private:
+  std::ostream *stream;
+  std::streambuf *sink;
+  std::FILE *spool;  // holds alignments, until the header is complete
+  bool isBam;
+  bool isHeaderLast;
+  bool isHeaderDone;
+
+  std::vector<char> inBuf;  // put area
+  std::string partialLine;
+  std::string hdLines;
+  std::string sqLines;
+  std::string otherLines;
+  std::map<std::string, int> refIds;
+  std::vector<std::string> refNames;
+  std::vector<long> refLengths;
+  std::string record;
+  std::vector<unsigned> cigarOps;
+
+  std::vector<char> block;  // uncompressed data for the next BGZF block
+  std::vector<char> zBlock;
+  z_stream z;
+
+  void consume(const char *beg, const char *end);
+  void doLine(const char *beg, const char *end);
+  void addHeaderLine(const char *beg, const char *end);
+  void writeHeader();
+  int refId(const char *beg, const char *end) const;
+  void addRecord(const char *beg, const char *end);
+  void put(const char *s, size_t n);
+  void writeBlock(const char *data, size_t size);
+  void flushBlock();
+  void writeOut(const char *s, size_t n);
+};
+
+}
+
+#endif
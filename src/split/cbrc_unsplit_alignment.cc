@@ -1,11 +1,11 @@
 // Copyright 2013, 2014 Martin C. Frith
 
 #include "cbrc_unsplit_alignment.hh"
+#include "mcf_number_text.hh"
 
 #include <ctype.h>
 #include <limits.h>
 #include <math.h>
-#include <stdio.h>
 #include <string.h>
 
 #include <algorithm>
@@ -94,7 +94,7 @@ struct Complement {
 };
 static Complement complement;
 
-static void reverseComplement(char *beg, char *end) {
+void reverseComplement(char *beg, char *end) {
   std::reverse(beg, end);
   std::transform(beg, end, beg, complement);
 }
@@ -292,8 +292,8 @@ size_t mafSlice(std::vector<char> &outputText, const UnsplitAlignment &aln,
       unsigned endPos = seqPosFromAlnPos(alnEnd, c);
       unsigned newBeg = aln.isFlipped() ? beg + len - endPos : beg + begPos;
       unsigned newLen = endPos - begPos;
-      w[2] = std::max(w[2], sprintf(begTexts[j], "%u", newBeg));
-      w[3] = std::max(w[3], sprintf(lenTexts[j], "%u", newLen));
+      w[2] = std::max(w[2], mcf::sprintUnsigned(begTexts[j], newBeg));
+      w[3] = std::max(w[3], mcf::sprintUnsigned(lenTexts[j], newLen));
       ++j;
     }
   }
@@ -50,6 +50,9 @@ void mafSliceEnd(const char* rAln, const char* qAln,
 
 double pLinesToErrorProb(const char *line1, const char *line2);
 
+// Reverse-complement DNA letters, keeping other characters (e.g. gaps)
+void reverseComplement(char *beg, char *end);
+
 }
 
 #endif
@@ -34,7 +34,7 @@ LastSplitOptions::LastSplitOptions()
     isSplicedAlignment(false) {}
 
 const char LastSplitOptions::helpf[] =
-  "output format: MAF, MAF+";
+  "output format: MAF, MAF+, SAM, BAM";
 
 const char LastSplitOptions::helpr[] =
   "reverse the roles of the 2 sequences in each alignment";
@@ -111,5 +111,7 @@ char LastSplitOptions::parseOutputFormat(const char *text) {
   }
   if (s == "maf")  return 'm';
   if (s == "maf+") return 'M';
+  if (s == "sam")  return 's';
+  if (s == "bam")  return 'S';
   return 0;
 }
@@ -2,11 +2,14 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "mcf_last_splitter.hh"
+#include "mcf_number_text.hh"
 
 #include <assert.h>
+#include <ctype.h>
 #include <limits.h>
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <algorithm>
@@ -38,6 +41,154 @@ static int printSense(char *out, double senseStrandLogOdds) {
   return sprintf(out, " sense=%.*g", precision, b);
 }
 
+struct MafRow {
+  std::string name;
+  unsigned long beg;
+  unsigned long len;
+  char strand;
+  unsigned long seqLen;
+  const char *aln;
+  const char *alnEnd;
+};
+
+static const char *nextWord(const char *p, std::string &word) {
+  while (*p == ' ' || *p == '\t') ++p;
+  const char *e = p;
+  while (*e > ' ') ++e;
+  word.assign(p, e);
+  return e;
+}
+
+static const char *readMafRow(const char *line, const char *end, MafRow &r) {
+  std::string word;
+  char *e;
+  const char *p = nextWord(line + 1, r.name);
+  r.beg = strtoul(p, &e, 10);
+  r.len = strtoul(e, &e, 10);
+  p = nextWord(e, word);
+  r.strand = word[0];
+  r.seqLen = strtoul(p, &e, 10);
+  p = e;
+  while (*p == ' ') ++p;
+  r.aln = p;
+  r.alnEnd = static_cast<const char *>(memchr(p, '\n', end - p));
+  return r.alnEnd + 1;
+}
+
+static void addCigarOp(std::string &cigar, char &oldOp, unsigned long &oldLen,
+		       char op, unsigned long len) {
+  if (op != oldOp) {
+    if (oldLen) {
+      char b[32];
+      cigar.append(b, sprintf(b, "%lu%c", oldLen, oldOp));
+    }
+    oldOp = op;
+    oldLen = 0;
+  }
+  oldLen += len;
+}
+
+// Get a tag's value from a MAF "a" line
+static std::string mafTag(const char *aLine, const char *aLineEnd,
+			  const char *tag) {
+  std::string a(aLine, aLineEnd - 1), word;  // omit the newline
+  size_t n = strlen(tag);
+  for (const char *p = a.c_str(); *p; ) {
+    p = nextWord(p, word);
+    if (word.compare(0, n, tag) == 0) return word.substr(n);
+  }
+  return "";
+}
+
+// Append one SAM line, made from one MAF block, like maf-convert
+static void appendSam(std::vector<char> &outputText,
+		      const char *aLine, const char *aLineEnd,
+		      const char *mafBeg, const char *mafEnd,
+		      bool isTopSeqQuery) {
+  MafRow rows[2];
+  const char *qual = 0;
+  int n = 0;
+  for (const char *p = mafBeg; p < mafEnd; ) {
+    if (*p == 's' && n < 2) {
+      p = readMafRow(p, mafEnd, rows[n++]);
+    } else {
+      if (*p == 'q' && n == 2 - isTopSeqQuery) {
+	std::string name;
+	qual = nextWord(p + 1, name);
+	while (*qual == ' ') ++qual;
+      }
+      p = static_cast<const char *>(memchr(p, '\n', mafEnd - p)) + 1;
+    }
+  }
+  if (n < 2) throw std::runtime_error("I need 2 sequences per alignment");
+
+  MafRow &r = rows[isTopSeqQuery];
+  MafRow &q = rows[!isTopSeqQuery];
+  std::string rAln(r.aln, r.alnEnd);
+  std::string qAln(q.aln, q.alnEnd);
+  std::string qQual(qual ? qual : "", qual ? qAln.size() : 0);
+  if (r.strand != '+') {  // flip the alignment, so the reference strand is +
+    cbrc::reverseComplement(&rAln[0], &rAln[0] + rAln.size());
+    cbrc::reverseComplement(&qAln[0], &qAln[0] + qAln.size());
+    std::reverse(qQual.begin(), qQual.end());
+    r.beg = r.seqLen - r.beg - r.len;
+    q.beg = q.seqLen - q.beg - q.len;
+    q.strand = (q.strand == '+') ? '-' : '+';
+  }
+
+  std::string cigar, seq, quals;
+  char op = 0;
+  unsigned long len = 0;
+  unsigned long editDistance = 0;
+  addCigarOp(cigar, op, len, 'H', q.beg);
+  for (size_t i = 0; i < rAln.size(); ++i) {
+    char x = rAln[i];
+    char y = qAln[i];
+    char c = (x == '-') ? 'I' : (y == '-') ? 'D'
+      : (toupper(x) == toupper(y)) ? '=' : 'X';
+    addCigarOp(cigar, op, len, c, 1);
+    editDistance += (c != '=');
+    if (y != '-') {
+      seq += y;
+      if (qual) quals += qQual[i];
+    }
+  }
+  addCigarOp(cigar, op, len, 'H', q.seqLen - q.beg - q.len);
+  addCigarOp(cigar, op, len, 0, 0);
+  if (quals.empty()) quals = "*";
+
+  int mapq = 255;
+  std::string mismap = mafTag(aLine, aLineEnd, "mismap=");
+  if (!mismap.empty()) {
+    double m = strtod(mismap.c_str(), 0);
+    mapq = (m > 0) ? std::min(floor(-10 * log10(m) + 0.5), 254.0) : 254;
+  }
+
+  int flag = (q.strand == '-') ? 16 : 0;
+  size_t s = q.name.size();
+  if (s > 1 && q.name[s - 2] == '/' && (q.name[s - 1] == '1' ||
+					q.name[s - 1] == '2')) {
+    bool isSecond = (q.name[s - 1] == '2');
+    q.name.resize(s - 2);
+    flag = (q.strand == '-') ? 83 + isSecond * 64 : 99 + isSecond * 64;
+  }
+
+  char b[64];
+  std::string out = q.name;
+  out.append(b, sprintf(b, "\t%d\t", flag));
+  out += r.name;
+  out.append(b, sprintf(b, "\t%lu\t%d\t", r.beg + 1, mapq));
+  out += cigar + "\t*\t0\t0\t" + seq + "\t" + quals;
+  out.append(b, sprintf(b, "\tNM:i:%lu", editDistance));
+  std::string score = mafTag(aLine, aLineEnd, "score=");
+  if (!score.empty() && score.find_first_not_of("0123456789") == score.npos)
+    out += "\tAS:i:" + score;
+  std::string evalue = mafTag(aLine, aLineEnd, "E=");
+  if (!evalue.empty()) out += "\tEV:Z:" + evalue;
+  out += '\n';
+  outputText.insert(outputText.end(), out.begin(), out.end());
+}
+
 namespace mcf {
 
 static void doOneSlice(SliceData &sd, unsigned &qSliceBeg, unsigned &qSliceEnd,
@@ -130,7 +281,8 @@ void LastSplitter::doOneAlignmentPart(const LastSplitOptions &opts,
   } else {
     out += sprintf(out, "a score=%d", sd.score);
   }
-  out += sprintf(out, " mismap=%.*g", mismapPrecision, mismap);
+  out = strcpy(out, " mismap=") + 8;
+  out += sprintGeneral(out, mismap, mismapPrecision);
   if (opts.direction == 2) out += printSense(out, senseStrandLogOdds);
   if (!opts.genome.empty() && !opts.no_split) {
     if (partNum > 0) {
@@ -146,6 +298,12 @@ void LastSplitter::doOneAlignmentPart(const LastSplitOptions &opts,
   }
   *out++ = '\n';
 
+  if (opts.format == 's' || opts.format == 'S') {
+    appendSam(outputText, &aLine[0], out, sliceBeg, sliceEnd,
+	      opts.isTopSeqQuery);
+    return;
+  }
+
   outputText.insert(outputText.end(), &aLine[0], out);
   outputText.insert(outputText.end(), sliceBeg, sliceEnd);
 
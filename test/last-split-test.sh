@@ -36,4 +36,6 @@ maf=SRR359290-1k.maf
 
     last-split -r split1.maf
 
+    last-split -m0.01 -fSAM $maf | head -n50
+
 } | diff -u last-split-test.out -
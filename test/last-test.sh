@@ -43,6 +43,12 @@ trap 'rm -f $db*' EXIT
     # FASTQ quality scores
     try lastal -Q1 -e90 -a9 $db $fastq
 
+    # SAM format
+    try lastal -Q1 -e90 -a9 -fSAM $db $fastq
+
+    # PAF format
+    try lastal -fPAF -e40 $db hg19-M.fa
+
     # gapless translated alignment & genetic code file
     lastdb -p -R10 $db $protSeq
     try lastal -F12 -pBL62 -e40 -G $gc -j1 $db $dnaSeq
@@ -120,9 +126,16 @@ trap 'rm -f $db*' EXIT
     lastdb -uMAM4 $db hg19-M.fa
     try lastal -e34 -C2 -f0 $db galGal3-M-32.fa
 
+    # chaining of gapless alignments
+    try lastal -e34 --chain=100 -f0 $db galGal3-M-32.fa
+    try lastal -e34 --chain=100 --band=8 -f0 $db galGal3-M-32.fa
+
     # minimum seed length
     try lastal -e34 -f0 -l30 $db galGal3-M-32.fa
 
+    # skip repetitive initial matches
+    try lastal -e34 -j1 -f0 --max-bucket-hits=1 $db galGal3-M-32.fa
+
     # match-counting with min & max lengths
     lastdb -m1 $db $dnaSeq
     try lastal -j0 -l4 -L11 -s0 $db $dnaSeq
@@ -199,9 +212,11 @@ trap 'rm -f $db*' EXIT
     # minimizers
     lastdb -W3 -R10 $db galGal3-M-32.fa
     try lastal -W19 -fTAB $db hg19-M.fa
+    try lastal -W19 -P3 --split-query=5000 -fTAB $db hg19-M.fa
 
     # minimum-difference alignment
     try lastal -W1 -M -fTAB $db hg19-M.fa
+    try lastal -W1 -M --bit-vector -fTAB $db hg19-M.fa
 
     # asymmetric gap costs
     try lastal -fTAB -j4 -A2 -B2 $db hg19-M.fa
@@ -211,6 +226,14 @@ trap 'rm -f $db*' EXIT
     try lastal -fTAB -j4 -Q0 -e90 -a7 -A12 -B4 -b9 -r6 -q18 $db $fastq
     try lastal -j4 -Qkeep -e90 -a7 -A12 -B4 -b9 -r6 -q18 $db $fastq
 
+    # reuse alignments of duplicate queries
+    try "cat $fastq $fastq | sed 's/^@SRR/@dup/;1,4000s/^@dup/@SRR/' |
+         lastal -fTAB -j4 -Q1 -e90 -a7 -A12 -B4 --dup-cache=100K $db | grep dup"
+
+    # aligning queries out of order shouldn't change the output
+    lastal -i10K -Q1 -e90 --split $db $fastq > $db.out
+    lastal -i10K -Q1 -e90 --split --sort-queries $db $fastq | diff $db.out -
+
     # first alignments only
     try lastal -N2 $db hg19-M.fa
 
@@ -243,6 +266,20 @@ trap 'rm -f $db*' EXIT
     lastdb -uRY8 -B1 $db hg19-M.fa
     lastal -fTAB -q8 -b4 $db galGal3-M-32.fa
 
+    # chaining where 2 gapless alignments can follow the same one:
+    # with -e100, each chain is too weak, but all 3 together are not
+    lastdb $db chain-branch-r.fa
+    try "lastal -vv -e70 --chain=100 $db chain-branch-q.fa 2>&1 |
+         grep 'gapped extensions'"
+    try "lastal -vv -e100 --chain=100 $db chain-branch-q.fa 2>&1 |
+         grep 'gapped extensions'"
+
+    # gapless alignments to adjacent reference sequences shouldn't chain:
+    # each one has score 60
+    lastdb $db chain-seqs-r.fa
+    try "lastal -vv -e100 --chain=100 $db chain-seqs-q.fa 2>&1 |
+         grep 'gapped extensions'"
+
     # tricky Forward-Backward bug that happened once
     lastdb $db alli.fa
     lastal -j7 -r5 -q5 -a15 -b3 $db huma.fa
@@ -254,6 +291,49 @@ trap 'rm -f $db*' EXIT
     lastdb --bits=4 -S2 -s1 -m1 $db galGal3-M-32.fa
     lastal -s0 -fTAB -p hufu.train $db hg19-M.fa
     lastal -fTAB -p hufu.train $db hg19-M.fa
+
+    # making volumes in the background shouldn't change them
+    lastal -fTAB $db hg19-M.fa > $db.out
+    lastdb --bits=4 -S2 -s1 -m1 --read-ahead=1K $db galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa | diff $db.out -
+
+    # a prefix cache shouldn't change the results
+    lastdb -b4 -m1 $db hg19-M.fa
+    lastal -fTAB $db galGal3-M-32.fa > $db.out
+    lastdb -b4 -m1 --prefix-cache=8 $db hg19-M.fa
+    lastal -fTAB $db galGal3-M-32.fa | diff $db.out -
+
+    # sorting the index in parts shouldn't change it
+    lastdb -uMAM4 $db hg19-M.fa
+    lastal -fTAB $db galGal3-M-32.fa > $db.out
+    lastdb -uMAM4 --sort-memory=10K $db hg19-M.fa
+    lastal -fTAB $db galGal3-M-32.fa | diff $db.out -
+
+    # multi-threaded lastdb should give the same database
+    lastdb -uMAM4 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa > $db.out
+    lastdb -P4 -uMAM4 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa | diff $db.out -
+    lastdb -w3 -m11101 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa > $db.out
+    lastdb -P4 -w3 -m11101 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa | diff $db.out -
+    lastdb -uRY4 -w2 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa > $db.out
+    lastdb -P4 -uRY4 -w2 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa | diff $db.out -
+    lastdb -S2 -s10K -uRY4 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa > $db.out
+    lastdb -P4 -S2 -s10K -uRY4 $db hg19-M.fa galGal3-M-32.fa
+    lastal -fTAB $db hg19-M.fa | diff $db.out -
+
+    # lastdb --append
+    lastdb -s1 $db galGal3-M-32.fa
+    lastdb --append -s1 $db hg19-M.fa
+    cat $db.prj
+    # these should fail, because the seed or -w differ:
+    lastdb --append -uMAM4 -s1 $db hg19-M.fa || echo append refused
+    lastdb --append -w2 -s1 $db hg19-M.fa || echo append refused
 } 2>&1 |
 grep -v version | diff -u last-test.out -
 